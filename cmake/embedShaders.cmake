@@ -0,0 +1,29 @@
+# Writes every GLSL file of SHADER_DIR into OUTPUT as a C array, so the
+# shaders are part of the binary. Run with cmake -P, see CMakeLists.txt.
+file(GLOB SHADERS "${SHADER_DIR}/*.vert" "${SHADER_DIR}/*.frag")
+list(SORT SHADERS)
+
+set(content "// generated from shader/ by cmake/embedShaders.cmake, do not edit\n")
+string(APPEND content "#ifndef SHADER_SOURCES_H\n#define SHADER_SOURCES_H\n\n")
+
+foreach(shader ${SHADERS})
+  # vertexShader.vert -> vertexShaderSource
+  get_filename_component(name ${shader} NAME_WE)
+  file(READ ${shader} hex HEX)
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+  # cmake regex has no {n}, 12 bytes per line
+  string(REPEAT "0x..," 12 line)
+  string(REGEX REPLACE "(${line})" "\\1\n    " bytes "${bytes}")
+  string(APPEND content "static const char ${name}Source[] = {\n    ${bytes}0x00};\n\n")
+endforeach()
+
+string(APPEND content "#endif\n")
+
+# only touched when something changed, the renderer isn't rebuilt otherwise
+set(previous "")
+if(EXISTS ${OUTPUT})
+  file(READ ${OUTPUT} previous)
+endif()
+if(NOT previous STREQUAL content)
+  file(WRITE ${OUTPUT} "${content}")
+endif()
@@ -0,0 +1,40 @@
+#ifndef AUDIO_GAIN_H
+#define AUDIO_GAIN_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+
+/**
+ * Volume of the stereo F32 output, applied in the audio stream callback right
+ * before the samples go to SDL. Any thread sets a target, the callback moves
+ * there within AUDIO_GAIN_RAMP_MS, a jump in gain would be heard as a click.
+ *
+ * Muting is a target of 0, the samples are then simply zeroed. A gain of 1
+ * leaves them untouched, everything else is a SIMD multiply (SSE or NEON,
+ * plain C elsewhere). All samples pass through here, so this is also where
+ * output metering belongs.
+ */
+
+#define AUDIO_GAIN_RAMP_MS 10
+
+typedef struct AudioGain {
+  SDL_AtomicU32 target; // float bits, written by any thread
+
+  // audio callback only
+  float current;
+  float rampTarget;
+  float rampStep; // per sample frame
+  int rampLeft;   // sample frames
+  int rampFrames;
+} AudioGain;
+
+void audio_gain_init(AudioGain *gain, int sampleRate, float initial);
+
+// any thread
+void audio_gain_set(AudioGain *gain, float target);
+float audio_gain_get(AudioGain *gain);
+
+// audio callback: scales frames interleaved stereo samples in place
+void audio_gain_apply(AudioGain *gain, float *samples, int frames);
+
+#endif
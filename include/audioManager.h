@@ -2,20 +2,60 @@
 #define AUDIO_MANAGER_H
 
 #include "mediaLoader.h" // Contains definitions for AudioContainer, aFrame, etc.
+#include "audioGain.h"
+#include "pcmRing.h"
+#include "playbackClock.h"
 #include <SDL3/SDL.h>
 
+/**
+ * How much audio is decoded ahead adapts to the machine. Every underrun (the
+ * callback needed more than the ring had, while the decoder was still
+ * delivering) doubles the target. After AUDIO_BUFFER_STABLE_MS without one it
+ * shrinks by an eighth, down to AUDIO_BUFFER_MIN_MS, the latency goal.
+ */
+#define AUDIO_BUFFER_MIN_MS 20
+#define AUDIO_BUFFER_START_MS 50
+#define AUDIO_BUFFER_MAX_MS 500
+#define AUDIO_BUFFER_STABLE_MS 10000
+
+// volume keys change the volume by this much, between 0 and 1
+#define AUDIO_VOLUME_STEP 0.1f
+
+typedef struct AudioManagerStats {
+  int underruns;
+  double targetMs;   // what the decoder keeps buffered
+  double bufferedMs; // decoded and waiting in the ring right now
+  double latencyMs;  // buffered plus the buffer of the device
+} AudioManagerStats;
+
 typedef struct AudioManager {
   AudioContainer *audio;        // FFmpeg audio container.
-  aFrame *audioFrame;           // Reusable audio frame structure.
+  aFrame *audioFrame;           // Reusable staging block for decoding.
   SDL_AudioStream *audioStream; // SDL3 audio stream device.
+  PlaybackClock clock;          // Audio position, the master clock.
+  PcmRing *ring;                // Decoded samples, pulled by the callback.
+  int ringSerial;               // Serial of the samples written last.
   SDL_Thread *audioThread;      // Audio thread pointer.
   volatile bool running;        // Flag to control the audio thread.
-  int buffer_threshold;         // Threshold in bytes (e.g., 16384).
+  AudioGain gain;               // Volume, applied in the callback.
+  float volume;                 // Gain when not muted.
   bool muted;
+
+  // adaptive buffering
+  SDL_AtomicInt bufferTarget; // bytes the decode thread keeps in the ring
+  SDL_AtomicInt underruns;
+  SDL_AtomicInt feeding;      // the decode thread delivers the current serial
+  bool starved;               // callback only, inside an underrun
+  int seenUnderruns;          // decode thread only
+  Uint64 stableSince;         // decode thread only, ticks of the last change
 } AudioManager;
 
-// Initializes the audio manager from a file path.
-int audio_manager_init(AudioManager *am, const char *filepath);
+// Initializes the audio manager from the audio stream of the demuxer.
+int audio_manager_init(AudioManager *am, Demuxer *demuxer);
+
+// same, with a container that was opened already (a prefetched file). The
+// manager owns it from then on, also when this fails.
+int audio_manager_init_container(AudioManager *am, AudioContainer *audio);
 
 // Starts the audio processing thread.
 void audio_manager_start(AudioManager *am);
@@ -23,6 +63,15 @@ void audio_manager_start(AudioManager *am);
 // Stops the audio processing thread.
 void audio_manager_stop(AudioManager *am);
 
+// a gain of 0 while muted, the samples are still decoded to keep the clock
+void audio_manager_set_muted(AudioManager *am, bool muted);
+
+// changes the volume by delta, between 0 and 1
+void audio_manager_change_volume(AudioManager *am, float delta);
+
+// underruns and latency, from any thread
+void audio_manager_get_stats(AudioManager *am, AudioManagerStats *stats);
+
 // Cleans up all audio-related resources.
 void audio_manager_cleanup(AudioManager *am);
 
@@ -0,0 +1,40 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// clang-format off
+#include <glad/glad.h>
+#include <SDL3/SDL.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "demuxer.h"
+#include "mediaLoader.h"
+#include "frameRing.h"
+#include "renderer.h"
+#include "wayWindowGL.h"
+// clang-format on
+
+/**
+ * "--bench <file>": runs demux -> decode -> convert -> upload -> draw as fast
+ * as possible on one thread, without the picker, audio or any clock sync.
+ * Uses SDL's offscreen video driver and the dummy audio driver, so it works on
+ * servers without a display or GPU (Mesa llvmpipe).
+ *
+ * Every stage is timed on the CPU. The GPU work of an upload can also show up
+ * in a later draw, the swap is part of the draw stage.
+ */
+
+typedef struct BenchmarkOptions {
+  const char *path;
+  RendererConfig rendererConfig;
+  int maxFrames; // 0 for the whole file
+  bool json;     // report as JSON instead of text
+} BenchmarkOptions;
+
+// returns the exit code for main
+int run_benchmark(const BenchmarkOptions *options);
+
+#endif
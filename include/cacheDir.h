@@ -0,0 +1,27 @@
+#ifndef CACHE_DIR_H
+#define CACHE_DIR_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Where the player keeps what it can rebuild at any time: keyframe indices
+ * and linked shader programs. $XDG_CACHE_HOME/LunaScape, or
+ * ~/.cache/LunaScape without it.
+ */
+
+#define CACHE_HASH_INIT 14695981039346656037ull
+
+// dir/<name> inside the cache directory, created on the way. name can be
+// NULL for the cache directory itself.
+bool cache_directory(const char *name, char *dir, size_t size);
+
+// FNV-1a over size bytes, continues from hash (CACHE_HASH_INIT to start).
+// Only spreads keys over file names, nothing cryptographic.
+uint64_t cache_hash(uint64_t hash, const void *data, size_t size);
+
+#endif
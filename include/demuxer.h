@@ -0,0 +1,124 @@
+#ifndef DEMUXER_H
+#define DEMUXER_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libavformat/avformat.h>
+
+#include "packetQueue.h"
+#include "seekIndex.h"
+#include "trace.h"
+
+/**
+ * The demuxer owns the only AVFormatContext of a file. It runs in its own
+ * thread, reads every packet exactly once and sorts them into one queue per
+ * stream. The video and the audio decoder only consume from these queues, so
+ * there is a single read position for both streams.
+ *
+ * Seeks go through the demuxer thread as well. A keyframe index of the video
+ * stream is built in the background (see seekIndex.h) and handed to the
+ * container, so av_seek_frame lands on the right keyframe without scanning.
+ * A fast seek continues at that keyframe, an accurate seek at the requested
+ * time: the decoders ask for the target after the flush and drop everything
+ * before it, video frames as well as audio samples.
+ *
+ * At the end of the file the demuxer thread starts over by itself, without
+ * a flush. A loop marker goes into both queues and the packets of the next
+ * pass get their timestamps shifted by the length of the file, so decoders,
+ * audio and clock simply continue: the start of the file is read and decoded
+ * ahead like any other packet, and the loop point is seamless.
+ */
+
+// limits of the packet queues, the demuxer pauses reading when they are full
+#define DEMUXER_VIDEO_MAX_BYTES (64 * 1024 * 1024)
+#define DEMUXER_AUDIO_MAX_BYTES (4 * 1024 * 1024)
+#define DEMUXER_MAX_DURATION 2.0 // seconds
+// longest wait with full queues or at the end, decoders and seeks wake it
+#define DEMUXER_WAIT_MS 100
+
+// how much probing may read, FFmpeg's defaults are 5 MB and 5 seconds. Plenty
+// for the first video and audio stream of common files, and much faster to
+// open.
+#define DEMUXER_PROBE_SIZE (2 * 1024 * 1024) // bytes
+#define DEMUXER_ANALYZE_DURATION 1000000     // AV_TIME_BASE units
+
+typedef enum SeekMode {
+  SEEK_FAST,    // continue at the keyframe before the requested time
+  SEEK_ACCURATE // decode from that keyframe, show the requested time
+} SeekMode;
+
+typedef struct Demuxer {
+  AVFormatContext *pFormatCtx;
+
+  int videoStreamIndex;
+  int audioStreamIndex;
+  PacketQueue videoQueue;
+  PacketQueue audioQueue;
+
+  SDL_Thread *thread;
+  SDL_Mutex *mutex;
+  SDL_Condition *cond; // wakes up the demuxer thread
+  volatile bool running;
+  bool eof;
+
+  bool seek_req;
+  double seek_seconds;
+  SeekMode seek_mode;
+
+  // where playback continues after the last seek, and the queue serials it
+  // belongs to
+  bool seek_target_valid;
+  double seek_target; // seconds
+  int seek_video_serial;
+  int seek_audio_serial;
+
+  SeekIndex *index; // NULL without a video stream
+
+  // looping, the timestamps of the current pass are shifted by loop_offset.
+  // Set before the start, the benchmark reads a file only once.
+  bool loop;
+  int64_t loop_offset; // AV_TIME_BASE units, demuxer thread only
+  int64_t pass_end;    // end of the latest packet, shifted
+  int64_t loop_length; // AV_TIME_BASE units, 0 before the first loop
+} Demuxer;
+
+// opens and probes the file, selects the first video and audio stream.
+Demuxer *demuxer_open(const char *filepath);
+
+// starts the demuxer thread and the keyframe index
+bool demuxer_start(Demuxer *demuxer);
+
+// reads one packet into its queue, what the thread does in a loop. Only for
+// callers that don't start the thread (the benchmark). Returns 0 at the end
+// of the file.
+int demuxer_read_packet(Demuxer *demuxer, AVPacket *packet);
+
+// requests a seek to seconds, the demuxer thread flushes both packet queues.
+void demuxer_seek(Demuxer *demuxer, double seconds, SeekMode mode);
+
+// the decoders: the first position to present for the packets of serial
+// from queue. Returns false if there is nothing to drop.
+bool demuxer_get_seek_target(Demuxer *demuxer, PacketQueue *queue, int serial,
+                             double *target);
+
+// seconds, 0 if the container doesn't know
+double demuxer_get_duration(Demuxer *demuxer);
+
+// timestamp of the start of the file in seconds, 0 if the container doesn't
+// know. Positions inside the file begin there, not at 0.
+double demuxer_get_start_time(Demuxer *demuxer);
+
+// position inside the file of a playback position, which keeps growing
+// with every loop
+double demuxer_file_position(Demuxer *demuxer, double seconds);
+
+// releases every decoder waiting for packets, call before stopping them.
+void demuxer_abort(Demuxer *demuxer);
+
+// stops the thread and frees everything
+void demuxer_close(Demuxer *demuxer);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/imgutils.h>
+
+/**
+ * Recycles the system memory frames hardware decoded frames are transferred
+ * into. Without it av_hwframe_transfer_data allocates (and later frees) a full
+ * size NV12/P010 buffer for every single frame.
+ *
+ * The buffers come from an AVBufferPool, sized from the hw frames context of
+ * the decoder (sw_format, width, height). A frame that is unreferenced gives
+ * its buffer back to the pool.
+ *
+ * The pool doesn't need a GPU: created with frame_pool_create it takes
+ * software frames, frame_pool_transfer then copies them like a transfer would.
+ */
+
+typedef struct FramePoolStats {
+  int requests; // frames handed out
+  int misses;   // requests that needed a new buffer, the size of the pool
+  int in_use;   // frames handed out and not given back yet
+} FramePoolStats;
+
+typedef struct FramePool {
+  AVBufferPool *pool;
+  enum AVPixelFormat format;
+  int width;
+  int height;
+  size_t bufferSize;
+
+  // one reference by the owner plus one per frame in use, the struct lives
+  // until the last pooled frame was unreferenced
+  SDL_AtomicInt refs;
+  SDL_AtomicInt requests;
+  SDL_AtomicInt misses;
+} FramePool;
+
+// pool for frames of the given software format and size
+FramePool *frame_pool_create(enum AVPixelFormat format, int width, int height);
+
+// pool matching the sw_format and size of a hw frames context
+FramePool *frame_pool_create_for_hw(AVBufferRef *hw_frames_ctx);
+
+// true if the pool was created for frames like the ones of hw_frames_ctx
+bool frame_pool_matches(FramePool *pool, AVBufferRef *hw_frames_ctx);
+
+// gives frame (unreferenced before) a pooled buffer in the pool format and
+// size. Returns 0 or a negative AVERROR.
+int frame_pool_get(FramePool *pool, AVFrame *frame);
+
+// transfers src into dst (unreferenced before) using a pooled buffer. A
+// hardware src is downloaded, a software src is copied.
+int frame_pool_transfer(FramePool *pool, AVFrame *dst, const AVFrame *src);
+
+void frame_pool_get_stats(FramePool *pool, FramePoolStats *stats);
+
+// frames still in use stay valid, their buffers are freed on unref
+void frame_pool_destroy(FramePool *pool);
+
+#endif
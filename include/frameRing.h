@@ -0,0 +1,71 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "mediaLoader.h"
+
+/**
+ * Fixed size ring of pre-allocated vFrames between exactly one producer (the
+ * video decode thread) and exactly one consumer (the render loop).
+ *
+ * There are no locks. The producer only writes writeIndex, the consumer only
+ * writes readIndex. Both are increasing counters, the slot is "index % size".
+ * SDL's atomic get/set are full memory barriers, so a slot is completely
+ * written before the consumer can see it and completely read before the
+ * producer can reuse it.
+ *
+ * The consumer can hold on to frames it already presented: when a frame was
+ * converted straight into a PBO slot, the GPU might still read it. Those
+ * frames are given back with frame_ring_release once their fence signaled.
+ *
+ * A producer with a full ring sleeps in frame_ring_wait, every slot the
+ * consumer gives back wakes it.
+ */
+
+// must be a power of two, so the slot stays right when the counters overflow
+#define FRAME_RING_SIZE 4
+
+typedef struct FrameRing {
+  vFrame *slots[FRAME_RING_SIZE];
+  SDL_AtomicU32 readIndex;
+  SDL_AtomicU32 writeIndex;
+  Uint32 peekIndex;      // consumer only, next frame to present
+  SDL_Semaphore *space; // signaled by the consumer
+} FrameRing;
+
+FrameRing *frame_ring_create(VideoContainer *video);
+void frame_ring_destroy(FrameRing *ring);
+
+// producer: returns the next free slot or NULL if the ring is full
+vFrame *frame_ring_peek_writable(FrameRing *ring);
+// producer: publishes the slot returned by frame_ring_peek_writable
+void frame_ring_push(FrameRing *ring);
+
+// producer: sleeps until the consumer gave a slot back, frame_ring_wake was
+// called or timeoutMS passed
+void frame_ring_wait(FrameRing *ring, Sint32 timeoutMS);
+// wakes a producer in frame_ring_wait, for example to stop it
+void frame_ring_wake(FrameRing *ring);
+
+// consumer: returns the next frame to present or NULL if the ring is empty
+vFrame *frame_ring_peek(FrameRing *ring);
+// consumer: gives the slot returned by frame_ring_peek (and every held one)
+// back to the producer
+void frame_ring_pop(FrameRing *ring);
+// consumer: moves on to the next frame but keeps the slot returned by
+// frame_ring_peek
+void frame_ring_advance(FrameRing *ring);
+// consumer: the oldest presented but held frame, NULL if there is none
+vFrame *frame_ring_peek_held(FrameRing *ring);
+// consumer: gives the slot returned by frame_ring_peek_held back
+void frame_ring_release(FrameRing *ring);
+
+// all slots the producer can't use right now, held frames included
+int frame_ring_count(FrameRing *ring);
+// consumer: frames that were not presented yet
+int frame_ring_pending(FrameRing *ring);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+// clang-format off
+#include <glad/glad.h>
+#include <SDL3/SDL.h>
+
+#include <stdbool.h>
+// clang-format on
+
+/**
+ * Measures how long the GPU spends on the upload and the draw of every frame,
+ * without waiting for it. Each frame gets its own GL_TIME_ELAPSED queries out
+ * of a small ring, the results are only read once GL_QUERY_RESULT_AVAILABLE
+ * says so, which is normally a few frames later. A query that is still busy
+ * when the ring comes around again is skipped for that frame instead of
+ * blocking, so this can stay on all the time.
+ *
+ * The results go into a histogram over the last GPU_TIMER_WINDOW frames.
+ */
+
+// frames in flight before a query is reused
+#define GPU_TIMER_RING_SIZE 8
+// frames in the rolling histogram
+#define GPU_TIMER_WINDOW 600
+// 0.1 ms per bucket, everything above the last bucket ends up in it
+#define GPU_TIMER_BUCKET_NS 100000
+#define GPU_TIMER_BUCKETS 200
+
+typedef enum GpuTimerStage {
+  GPU_STAGE_UPLOAD, // glTexSubImage2D of all planes
+  GPU_STAGE_DRAW,   // the quad with the YUV -> RGB shader
+  GPU_STAGE_COUNT
+} GpuTimerStage;
+
+typedef struct GpuTimeHistogram {
+  GLuint64 window[GPU_TIMER_WINDOW]; // ns, oldest gets replaced
+  int windowCount;
+  int windowIndex;
+  int buckets[GPU_TIMER_BUCKETS];
+  GLuint64 maxNs; // of the whole run
+} GpuTimeHistogram;
+
+typedef struct GpuTimerStats {
+  int count; // frames in the window
+  double p50Ms;
+  double p95Ms;
+  double p99Ms;
+  double maxMs; // of the whole run
+  int skipped;  // frames not measured, the query was still busy
+} GpuTimerStats;
+
+typedef struct GpuTimer {
+  GLuint queries[GPU_TIMER_RING_SIZE][GPU_STAGE_COUNT];
+  bool pending[GPU_TIMER_RING_SIZE][GPU_STAGE_COUNT]; // waits for its result
+  bool running[GPU_STAGE_COUNT]; // began in this frame and not ended yet
+  int frameIndex;                // slot of the current frame
+  GpuTimeHistogram histograms[GPU_STAGE_COUNT];
+  int skipped[GPU_STAGE_COUNT];
+} GpuTimer;
+
+void initGpuTimer(GpuTimer *timer);
+
+// around the GL calls of one stage, at most once per stage and frame
+void beginGpuTimer(GpuTimer *timer, GpuTimerStage stage);
+void endGpuTimer(GpuTimer *timer, GpuTimerStage stage);
+
+// once per frame: collects every finished result and moves to the next slot
+void advanceGpuTimer(GpuTimer *timer);
+
+void getGpuTimerStats(GpuTimer *timer, GpuTimerStage stage,
+                      GpuTimerStats *stats);
+
+const char *gpuTimerStageName(GpuTimerStage stage);
+
+void cleanupGpuTimer(GpuTimer *timer);
+
+#endif
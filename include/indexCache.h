@@ -0,0 +1,92 @@
+#ifndef INDEX_CACHE_H
+#define INDEX_CACHE_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libavformat/avformat.h>
+
+#include "cacheDir.h"
+
+/**
+ * Sidecar file with the keyframe index of a video and a summary of its
+ * streams, so a file that was played before opens without probing and seeks
+ * instantly from the start.
+ *
+ * The files live in $XDG_CACHE_HOME/LunaScape (~/.cache/LunaScape without
+ * it), one per video, named after a hash of its absolute path. A file only
+ * counts when the path, size and mtime of the video still match. The layout
+ * is a fixed header, the path, and the SeekIndexEntry array, so the entries
+ * are used straight from the memory mapping.
+ */
+
+#define INDEX_CACHE_VERSION 3
+
+// what avformat_find_stream_info would have found, enough to open the
+// decoders without probing again
+typedef struct IndexCacheStreams {
+  int32_t nbStreams;
+  int32_t videoStreamIndex; // -1 without video
+  int32_t audioStreamIndex; // -1 without audio
+
+  int32_t videoCodecId;
+  int32_t width;
+  int32_t height;
+  int32_t pixelFormat;
+  int32_t frameRateNum;
+  int32_t frameRateDen;
+
+  int32_t audioCodecId;
+  int32_t sampleRate;
+  int32_t channels;
+
+  int64_t duration; // AV_TIME_BASE units
+
+  // first timestamps, also only known after probing. Looping starts over at
+  // startTime.
+  int64_t startTime;      // AV_TIME_BASE units
+  int64_t videoStartTime; // time base of the video stream
+  int64_t audioStartTime; // time base of the audio stream
+} IndexCacheStreams;
+
+typedef struct IndexCacheHeader {
+  char magic[4]; // "LSIX"
+  uint32_t version;
+  uint32_t entrySize; // sizeof(SeekIndexEntry) of the writer
+  uint32_t pathLength;
+  int64_t fileSize;
+  int64_t mtimeNs;
+  int64_t count;
+  IndexCacheStreams streams;
+} IndexCacheHeader;
+
+// a mapped sidecar file
+typedef struct IndexCache {
+  void *base;
+  size_t size;
+  const IndexCacheHeader *header;
+  const void *entries; // header->count SeekIndexEntry
+} IndexCache;
+
+// maps the sidecar of path. NULL when there is none, or it belongs to an
+// older version of the file.
+IndexCache *index_cache_open(const char *path);
+
+void index_cache_close(IndexCache *cache);
+
+// fills what avformat_open_input left out from the cached summary. Returns
+// false if the streams don't match it, then the file needs probing.
+bool index_cache_apply(const IndexCache *cache, AVFormatContext *pFormatCtx);
+
+// the summary of an already probed file
+void index_cache_describe(AVFormatContext *pFormatCtx, int videoStreamIndex,
+                          int audioStreamIndex, IndexCacheStreams *streams);
+
+// writes the sidecar of path, replacing an old one
+bool index_cache_save(const char *path, const IndexCacheStreams *streams,
+                      const void *entries, int64_t count, size_t entrySize);
+
+#endif
@@ -18,6 +18,9 @@
 #include "renderer.h"
 #include "mediaPicker.h"
 #include "audioManager.h"
+#include "videoDecoder.h"
+#include "benchmark.h"
+#include "trace.h"
 
 
 #endif
\ No newline at end of file
@@ -28,6 +28,9 @@
 #include <libavutil/samplefmt.h>      // Audio: Sample-Formats
 #include <libswresample/swresample.h> // Audio: Resampling
 
+#include "demuxer.h"
+#include "framePool.h"
+
 /**
  * General information:
  *
@@ -85,22 +88,32 @@
 // ffmpeg configuration
 
 /**
- * pFormatCtx contains general information about the file.argc
+ * pFormatCtx contains general information about the file. It belongs to the
+ * demuxer, which reads the file once and hands out the packets.
  * pCodecCtx is managing the video decoder
  * pCodec will be used for the actual decoder
  * videoStreamIndex contains the index of the first video stream
- * a swsContext for converting RGB data to YUV420P data
+ * hw_frame_pool recycles the frames hardware decoded frames are transferred
+ * into.
+ * upload_fmt is the pixel format the renderer gets. YUV420P, YUV444P, NV12
+ * and the 10-bit YUV420P10 and P010 are uploaded as they are and converted
+ * in the shader, other formats are converted to RGB24 by a swsContext.
  */
 
 typedef struct VideoContainer {
 
-  AVFormatContext *pFormatCtx;
+  Demuxer *demuxer;
+  AVFormatContext *pFormatCtx; // borrowed from the demuxer, read-only
   AVCodecContext *pCodecCtx;
   AVBufferRef *hw_device_ctx;
+  FramePool *hw_frame_pool;
 
   const AVCodec *pCodec;
   int videoStreamIndex;
-  bool paused;
+  int serial; // serial of the last packet, changes after a seek
+  bool looping; // the decoder drains the last pass before the loop point
+  volatile bool paused;
+  enum AVPixelFormat upload_fmt;
   struct SwsContext *sws_ctx;
   struct SwsContext *hw_sws_ctx; // sws codec for Hardware-Decoding
 
@@ -110,41 +123,69 @@ typedef struct VideoContainer {
  *
  * *packet saves all the compressed information (frames)
  * *frame saves all decoded frames
- * *frameYUV is for the YUV converted frames
+ * *swFrame receives hardware decoded frames transferred to system memory
+ * *frameYUV holds the planes in upload_fmt. They point into the PBO slot of
+ *  the frame, into frame (or swFrame) directly or into imgBuffer, when a
+ *  conversion was needed
+ * uploadData/uploadLinesize are the planes inside the persistent mapped PBO
+ *  slot the renderer reserved for this frame (uploadSlot, -1 if there is
+ *  none). The frame is converted or copied straight into it.
+ * pts is the presentation time in seconds, serial the packet serial it was
+ * decoded from
  *
  */
 
 typedef struct vFrame {
   AVFrame *frame;
+  AVFrame *swFrame;
   AVFrame *frameYUV;
   AVPacket *packet;
   uint8_t *imgBuffer;
+  uint8_t *uploadData[4];
+  int uploadLinesize[4];
+  int uploadSlot;
+  double pts;
+  int serial;
 } vFrame;
 
 // Same structs for audio decoding
 
 typedef struct AudioContainer {
-  AVFormatContext *pFormatCtx;
+  Demuxer *demuxer;
+  AVFormatContext *pFormatCtx; // borrowed from the demuxer, read-only
   AVCodecContext *pCodecCtx;
 
   const AVCodec *pCodec;
   int audioStreamIndex;
-  bool paused;
+  int serial;
+  double next_pts; // where the next frame starts, for frames without a pts
+  bool draining;   // end of file, the decoder got its flush packet
+  bool flushed;    // the decoder is drained and the resampler tail staged
+  bool looping;    // the decoder drains the last pass before the loop point
+  bool loopGap;    // first frame after the loop point, gaps get silence
+  bool trimming;   // samples before trim_pts are dropped, after a seek
+  double trim_pts;
   struct SwrContext *swr_ctx;
 } AudioContainer;
 
+// convertedData is a staging block of converted samples of one or more
+// frames, end_pts is the pts (seconds) right after the last staged sample,
+// serial the packet serial they were decoded from
 typedef struct aFrame {
   AVFrame *frame;
   AVPacket *packet;
-  uint8_t **convertedData;
-  int convertedDataSize;
+  uint8_t *convertedData;         // stereo F32, packed
+  int convertedDataSize;          // bytes staged
+  unsigned int convertedCapacity; // bytes, the block only grows
+  double end_pts;
+  int serial;
 } aFrame;
 
 // VIDEO DECODING FUNCTIONS
 enum AVPixelFormat get_hw_format(AVCodecContext *ctx,
                                  const enum AVPixelFormat *pix_fmts);
 
-VideoContainer *init_video_container(const char *filepath, bool force_software);
+VideoContainer *init_video_container(Demuxer *demuxer, bool force_software);
 
 void free_video_data(VideoContainer *video);
 
@@ -152,14 +193,31 @@ vFrame *init_video_frames(VideoContainer *video);
 
 void free_video_frames(vFrame *videoFrame);
 
+// decodes the next frame into videoFrame->frame. Returns 1 for a decoded
+// frame, 0 at the end of the file (or on an error) and -1 when the demuxer
+// was aborted.
+int video_container_decode_frame(VideoContainer *video, vFrame *videoFrame);
+
+// transfers (hardware decoding) and converts the decoded frame into
+// videoFrame->frameYUV
+bool video_container_convert_frame(VideoContainer *video, vFrame *videoFrame);
+
+// both of the above, same return values as video_container_decode_frame
 int video_container_get_frame(VideoContainer *video, vFrame *videoFrame);
 
 // AUDIO DECODING FUNCTIONS
 
-AudioContainer *init_audio_container(const char *filepath);
+AudioContainer *init_audio_container(Demuxer *demuxer);
 void free_audio_data(AudioContainer *audio);
 aFrame *init_audio_frames(AudioContainer *audio);
 void free_audio_frames(aFrame *audioFrame);
-int audio_container_get_frame(AudioContainer *audio, aFrame *audioFrame);
+// decodes every frame the decoder has, feeding it packets as needed, and
+// stages the converted samples in audioFrame->convertedData until at least
+// wanted bytes are there. Stops early when the demuxer has no packet ready
+// and something is staged already. At the end of the file the decoder and
+// the resampler are drained. Returns 1 if samples are staged, 0 when there is
+// nothing (end of file) and -1 when the demuxer was aborted.
+int audio_container_decode_samples(AudioContainer *audio, aFrame *audioFrame,
+                                   int wanted);
 
 #endif
\ No newline at end of file
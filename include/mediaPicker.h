@@ -12,11 +12,31 @@
 
 #include "mediaLoader.h"
 #include "audioManager.h"
+#include "videoDecoder.h"
+#include "playlist.h"
 
 
+/**
+ * The file dialog (kdialog) runs as a child process.
+ * KDE_Plasma_select_video_file waits for it, media_picker_open_async runs it
+ * on its own thread: the picked file is opened and prepared there too and
+ * arrives as an event of media_picker_event_type with the PreparedMedia in
+ * user.data1 (NULL when nothing was picked). The render loop keeps playing
+ * meanwhile.
+ */
+
 char *KDE_Plasma_select_video_file(void);
 
-bool reload_video_and_audio(VideoContainer **video, vFrame **videoFrame,
-    AudioManager *audioManager, uint64_t *start_time);
+Uint32 media_picker_event_type(void);
+
+// false if a dialog is open already
+bool media_picker_open_async(PlaybackClock *clock);
+
+// closes an open dialog and frees a picked file that was never played
+void media_picker_shutdown(void);
+
+bool switch_media(PreparedMedia *next, Demuxer **demuxer,
+    VideoContainer **video, VideoDecoder **videoDecoder,
+    AudioManager *audioManager);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef PACKET_QUEUE_H
+#define PACKET_QUEUE_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+
+/**
+ * A thread safe FIFO of compressed packets for one stream.
+ *
+ * The demuxer thread puts packets in, a decoder takes them out. Every packet
+ * carries the "serial" of the queue at the time it was put. A flush (after a
+ * seek) increments the serial, so a decoder can notice that it has to flush
+ * its own buffers as soon as it gets a packet with a new serial.
+ *
+ * When the file loops, a marker without a packet separates the last packet
+ * of the file from the first one of the next pass. The decoder drains and
+ * flushes itself there, the serial stays the same.
+ *
+ * The queue is bounded by a byte count and by a duration. The queue itself
+ * never blocks the producer, the demuxer asks packet_queue_is_full() and
+ * waits on its own condition. Taking a packet out of a full queue signals
+ * that condition (see packet_queue_set_producer).
+ */
+
+#define PACKET_QUEUE_LOOP 2
+
+typedef struct PacketNode {
+  AVPacket *packet;
+  int serial;
+  bool loop; // loop marker, no packet
+  struct PacketNode *next;
+} PacketNode;
+
+typedef struct PacketQueue {
+  PacketNode *first;
+  PacketNode *last;
+
+  int nb_packets;
+  int64_t size;     // bytes of all queued packets
+  int64_t duration; // sum of packet durations in time_base units
+  AVRational time_base;
+
+  int64_t max_bytes;   // limit by byte count
+  double max_duration; // limit by duration in seconds
+
+  int serial;
+  bool eof;   // demuxer reached the end of the file
+  bool abort; // wakes up and releases every waiting consumer
+
+  SDL_Mutex *mutex;
+  SDL_Condition *cond;
+
+  // the producer waits on this while the queue is full, can be NULL
+  SDL_Mutex *producer_mutex;
+  SDL_Condition *producer_cond;
+} PacketQueue;
+
+int packet_queue_init(PacketQueue *q, AVRational time_base, int64_t max_bytes,
+                      double max_duration);
+void packet_queue_destroy(PacketQueue *q);
+
+// cond (with its mutex) is signaled whenever a consumer makes room in a full
+// queue
+void packet_queue_set_producer(PacketQueue *q, SDL_Mutex *mutex,
+                               SDL_Condition *cond);
+
+// takes over the reference of packet, packet is empty afterwards.
+int packet_queue_put(PacketQueue *q, AVPacket *packet);
+
+// the file starts over after the packets put so far
+int packet_queue_put_loop(PacketQueue *q);
+
+/**
+ * returns 1 if a packet was written into packet, 0 if the queue is empty and
+ * the demuxer reached the end of the file, -1 if the queue was aborted.
+ * When block is false, an empty queue (not eof) returns -2. A loop marker
+ * returns PACKET_QUEUE_LOOP, packet stays empty.
+ */
+int packet_queue_get(PacketQueue *q, AVPacket *packet, int *serial,
+                     bool block);
+
+// drops every packet and increments the serial.
+void packet_queue_flush(PacketQueue *q);
+
+void packet_queue_set_eof(PacketQueue *q, bool eof);
+void packet_queue_abort(PacketQueue *q);
+bool packet_queue_is_full(PacketQueue *q);
+int64_t packet_queue_size(PacketQueue *q);
+int packet_queue_count(PacketQueue *q);
+int packet_queue_serial(PacketQueue *q);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * Ring of decoded and converted PCM bytes between exactly one producer (the
+ * audio decode thread) and exactly one consumer (the SDL audio stream
+ * callback, on SDL's audio device thread).
+ *
+ * Like the frame ring there are no locks, only increasing byte counters that
+ * each side writes alone. Every written chunk also leaves a mark with the pts
+ * right after its last byte and its packet serial, so the callback knows the
+ * pts of whatever it hands to the device.
+ *
+ * After a seek the producer sets a discard mark at its write position, the
+ * consumer skips everything before it on its next read. A semaphore wakes the
+ * producer whenever the consumer took data out of the ring.
+ */
+
+// chunks in the ring at the same time
+#define PCM_RING_MARKS 64
+
+typedef struct PcmMark {
+  Uint32 end;    // byte counter right after the chunk
+  double endPts; // seconds
+  int serial;
+} PcmMark;
+
+typedef struct PcmRing {
+  uint8_t *data;
+  Uint32 capacity; // bytes, a power of two
+  int bytesPerSecond;
+
+  SDL_AtomicU32 readIndex;  // consumer only
+  SDL_AtomicU32 writeIndex; // producer only
+  SDL_AtomicU32 discardIndex;
+
+  PcmMark marks[PCM_RING_MARKS];
+  SDL_AtomicU32 markRead;
+  SDL_AtomicU32 markWrite;
+
+  SDL_Semaphore *space; // signaled by the consumer
+} PcmRing;
+
+// holds at least minBytes, rounded up to a power of two
+PcmRing *pcm_ring_create(int minBytes, int bytesPerSecond);
+void pcm_ring_destroy(PcmRing *ring);
+
+// bytes written but not consumed yet
+int pcm_ring_buffered(PcmRing *ring);
+
+// producer: bytes that can be written right now, 0 when all marks are used
+int pcm_ring_space(PcmRing *ring);
+// producer: copies size bytes (at most pcm_ring_space) into the ring, endPts
+// is the pts right after the last byte
+bool pcm_ring_write(PcmRing *ring, const uint8_t *data, int size,
+                    double endPts, int serial);
+// producer: everything written so far is skipped by the consumer
+void pcm_ring_discard(PcmRing *ring);
+// producer: waits until the consumer took data, or the timeout ran out
+void pcm_ring_wait(PcmRing *ring, Sint32 timeoutMS);
+// wakes a producer in pcm_ring_wait, for example to stop it
+void pcm_ring_wake(PcmRing *ring);
+
+// consumer: the next contiguous bytes of one chunk, at most max. The
+// pointer stays valid and writable until pcm_ring_consume. Returns 0 if
+// the ring is empty.
+int pcm_ring_peek(PcmRing *ring, uint8_t **data, int max, double *endPts,
+                  int *serial);
+// consumer: gives bytes returned by pcm_ring_peek back to the producer
+void pcm_ring_consume(PcmRing *ring, int size);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef PLAYBACK_CLOCK_H
+#define PLAYBACK_CLOCK_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+
+/**
+ * Audio is the master clock. The audio stream pulls its data through a
+ * callback, which queues the samples and stamps the pts they end at together
+ * with the time it ran. The position at that moment is that pts minus
+ * everything that still waits to be played: the bytes queued in the stream
+ * (stereo F32 after swr_convert) and the buffer of the audio device.
+ *
+ * The callback only runs once per device buffer, in between the position is
+ * extrapolated with the wall clock.
+ *
+ * pts and ticks are 64 bit values written by the audio callback and read by
+ * the render loop and the video decoder, a spinlock keeps them consistent.
+ * Nobody touches the audio stream while holding it, the callback runs with
+ * the lock of the stream held.
+ */
+
+typedef struct PlaybackClock {
+  SDL_SpinLock lock;
+  SDL_AudioStream *stream;
+  int bytesPerSecond; // of the data put into the stream
+  double latency;     // seconds the device buffers behind the stream
+
+  // stamped by the audio callback
+  double pts;   // position when the callback ran, or when it got paused
+  Uint64 ticks; // SDL_GetTicksNS of that position
+  int serial;   // packet serial of the queued samples, -1 if none
+  bool paused;
+} PlaybackClock;
+
+void playback_clock_init(PlaybackClock *clock, SDL_AudioStream *stream,
+                         int sampleRate, int channels, int bytesPerSample);
+
+// audio callback: queues data into the stream and stamps the pts its last
+// sample ends at. Data of a new serial replaces the queued data of the old
+// one. Returns false if SDL_PutAudioStreamData failed.
+bool playback_clock_queue(PlaybackClock *clock, const void *data, int size,
+                          double endPts, int serial);
+
+// forgets the queued audio, for example after a seek
+void playback_clock_reset(PlaybackClock *clock);
+
+void playback_clock_set_paused(PlaybackClock *clock, bool paused);
+
+// the current audio position in seconds. Returns false when no audio of the
+// given serial was queued yet, the caller needs another clock then.
+bool playback_clock_get(PlaybackClock *clock, int serial, double *position);
+
+// like playback_clock_get, but without the extrapolation. Might be behind by
+// up to one device buffer.
+bool playback_clock_peek(PlaybackClock *clock, int serial, double *position);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <SDL3/SDL.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mediaLoader.h"
+#include "playbackClock.h"
+#include "videoDecoder.h"
+
+/**
+ * Files given on the command line (or every video inside a given directory)
+ * are played one after another, the last one is followed by the first again.
+ *
+ * While one file plays, the next one is prepared on a background thread:
+ * opened, probed, both decoders set up, its demuxer already reading and the
+ * first frame decoded. Switching then only stops the old threads and starts
+ * the new ones, the new picture is there right away. A single file is not a
+ * playlist, it simply loops.
+ */
+
+// a file opened and ready to play, only started threads are missing
+typedef struct PreparedMedia {
+  char *path;
+  Demuxer *demuxer; // reading already
+  VideoContainer *video;
+  VideoDecoder *videoDecoder; // first frame decoded, thread not started
+  AudioContainer *audio;
+} PreparedMedia;
+
+// opens path for playback, frames are dropped against clock. With loop the
+// file starts over at its end. NULL if the file can't be played.
+PreparedMedia *media_prepare(const char *path, PlaybackClock *clock,
+                             bool loop);
+
+// hands the containers and the threads over to the caller, frees the rest
+void media_prepared_take(PreparedMedia *media, Demuxer **demuxer,
+                         VideoContainer **video, VideoDecoder **videoDecoder,
+                         AudioContainer **audio);
+
+// frees everything that was not taken over
+void media_prepared_free(PreparedMedia *media);
+
+typedef struct Playlist {
+  char **paths;
+  int count;
+  int capacity;
+  int current;
+  PlaybackClock *clock;
+
+  // the next file, prepared in the background
+  SDL_Thread *prefetchThread;
+  int prefetchIndex;
+  PreparedMedia *prefetched; // written by the thread, read after joining it
+} Playlist;
+
+void playlist_init(Playlist *playlist, PlaybackClock *clock);
+
+// a video file, or every video inside a directory (sorted by name)
+bool playlist_add(Playlist *playlist, const char *path);
+
+// more than one file, files play once and then the next one starts
+bool playlist_is_active(Playlist *playlist);
+
+// prepares the current file, on the calling thread
+PreparedMedia *playlist_open_current(Playlist *playlist);
+
+// starts preparing the file after the current one
+void playlist_prefetch(Playlist *playlist);
+
+// moves step files forward (or back) and returns that file prepared, the
+// prefetched one when it matches.
+PreparedMedia *playlist_next(Playlist *playlist, int step);
+
+void playlist_destroy(Playlist *playlist);
+
+#endif
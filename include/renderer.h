@@ -12,31 +12,125 @@
 
 #include "shader.h"
 #include "mediaLoader.h"
+#include "frameRing.h"
+#include "glExtensions.h"
+#include "gpuTimer.h"
+#include "trace.h"
 
 // clang-format on
 
+// one texture per plane of the uploaded frame. RGB24 frames have a single
+// RGB plane, YUV frames are uploaded as R8 (Y, U, V) and RG8 (interleaved UV)
+// textures, 10-bit frames as R16 and RG16. The fragment shader variant of the
+// format converts them to RGB.
+typedef struct TexturePlane {
+
+  GLuint texture;
+  int width;
+  int height;
+  int bytesPerPixel;
+  GLint internalFormat;
+  GLenum format;
+  GLenum type; // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT for 10-bit planes
+  size_t offset; // offset of the plane inside a PBO
+
+} TexturePlane;
+
+// how a frame gets from system memory into the textures
+typedef enum UploadMode {
+  UPLOAD_DIRECT,         // glTexSubImage2D straight from the frame
+  UPLOAD_PBO,            // two PBOs, orphaned with glBufferData every frame
+  UPLOAD_PERSISTENT_PBO, // ring of persistent mapped PBO slots, fenced
+} UploadMode;
+
+// the decode thread can only convert into the ring when every frame ring slot
+// has its own PBO slot, smaller rings are filled by the render thread.
+#define PBO_RING_MIN_DEPTH 2
+#define PBO_RING_MAX_DEPTH 8
+#define PBO_RING_DEFAULT_DEPTH FRAME_RING_SIZE
+
+typedef struct RendererConfig {
+  UploadMode uploadMode;
+  int pboDepth;     // slots of the persistent PBO ring
+  bool toneMapping; // PQ and HLG video is tone mapped to SDR
+} RendererConfig;
+
+// the HDR stage of the shader, picked from the transfer function of the frames
+typedef enum ToneMapping {
+  TONE_MAP_NONE, // SDR, or tone mapping turned off
+  TONE_MAP_PQ,   // SMPTE ST 2084
+  TONE_MAP_HLG,  // ARIB STD-B67
+} ToneMapping;
+
 typedef struct Renderer {
 
   GLuint vao;
   GLuint vbo;
   GLuint ebo;
+  RendererConfig config;
   GLuint pbo[2];
   int pboIndex;
-  GLuint texture;
-  Shader shader;
-  GLuint queryID;
+
+  // persistent mapped PBO ring: one buffer with pboDepth slots, mapped once.
+  // A fence per slot tells when the GPU is done reading it.
+  GLuint ringBuffer;
+  uint8_t *ringPtr;
+  size_t ringSlotSize;
+  GLsync ringFences[PBO_RING_MAX_DEPTH];
+  int ringIndex;
+
+  TexturePlane planes[3];
+  int planeCount;
+  size_t frameSize; // bytes of all planes
+  enum AVPixelFormat format;
+  int bitDepth; // of the samples, 8 or 10
+  int colorspace; // colorspace and range of the current color matrix
+  int colorRange;
+  Shader shader; // the variant for format and toneMap
+  ToneMapping toneMap;
+  float transform[16]; // set again when the shader variant changes
+  GpuTimer gpuTimer; // GPU time of every upload and draw, always on
 
 } Renderer;
 
-// setting up data before the actual render loop
-void initRenderer(Renderer *renderer, int texWidth, int texHeight);
+// compiles the shader variants of the common upload formats ahead, while the
+// video is still being opened. initRenderer only picks one of them then.
+void preloadRendererShader(void);
+
+// deletes the shader programs of all renderers, before the GL context goes
+void releaseRendererShaders(void);
+
+// setting up data before the actual render loop, format is the upload format
+// of the video (see VideoContainer.upload_fmt). config can be NULL for the
+// default (persistent PBO ring).
+void initRenderer(Renderer *renderer, int texWidth, int texHeight,
+                  enum AVPixelFormat format, const RendererConfig *config);
 
 // use in render loop, OpenGL actual rendering
-void renderFrame(Renderer *renderer, unsigned int srcWidth,
-                 unsigned int srcHeight, vFrame *videoFrame);
+void renderFrame(Renderer *renderer, vFrame *videoFrame);
 
-void renderFrameWithPBO(Renderer *renderer, unsigned int srcWidth,
-                        unsigned int srcHeight, vFrame *videoFrame);
+void renderFrameWithPBO(Renderer *renderer, vFrame *videoFrame);
+
+void renderFrameWithPersistentPBO(Renderer *renderer, vFrame *videoFrame);
+
+// uses the render function of the configured upload mode
+void renderVideoFrame(Renderer *renderer, vFrame *videoFrame);
+
+// only the upload part of renderVideoFrame, renderFrameWithoutUpdate draws
+void uploadVideoFrame(Renderer *renderer, vFrame *videoFrame);
+
+// gives every frame of the ring its own slot of the persistent mapped PBO
+// ring, so the decode thread converts straight into upload memory. Has to be
+// called before the decode thread starts. Returns false (and the frames are
+// copied by the render thread) in the other upload modes.
+bool attachFrameRing(Renderer *renderer, FrameRing *ring);
+
+// true while the GPU might still read the PBO slot of the frame, the frame
+// ring slot must not be given back to the decode thread before.
+bool isFrameInUse(Renderer *renderer, vFrame *videoFrame);
+
+// blocks until the GPU finished reading the PBO slot of the frame
+void waitFrameUpload(Renderer *renderer, vFrame *videoFrame);
 
 void renderFrameWithoutUpdate(Renderer *renderer);
 
@@ -48,7 +142,11 @@ void updateVideoTranformation(Renderer *renderer, int windowWidth,
 // Destroy data from OpenGL
 void cleanupRenderer(Renderer *renderer);
 
-void startTimerQuery(Renderer *renderer);
-void endTimerQuery(Renderer *renderer);
+// "tex", "pbo" or "persistent", for the command line
+bool parseUploadMode(const char *name, UploadMode *mode);
+const char *uploadModeName(UploadMode mode);
+
+// p50/p95/p99 of the GPU upload and draw time over the last frames
+void printGpuTimes(Renderer *renderer);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libavformat/avformat.h>
+
+#include "indexCache.h"
+
+/**
+ * In-memory index of the keyframes of the video stream: pts, dts, byte
+ * position and size of every keyframe packet.
+ *
+ * It is built in the background by its own thread with its own
+ * AVFormatContext, which only reads packets (no decoding, other streams are
+ * discarded) at low priority. The index stays private, the container's own
+ * index is never touched. A seek looks up the keyframe here and seeks to its
+ * dts (or its byte position), so it jumps straight to the right GOP even in
+ * files without cues, and fast seeks know the exact keyframe they land on.
+ *
+ * A finished scan is written to the sidecar cache (see indexCache.h). When
+ * the file is opened again, the mapped entries of the cache are used as they
+ * are and nothing is scanned.
+ */
+
+typedef struct SeekIndexEntry {
+  int64_t pts; // video stream time base
+  int64_t dts; // video stream time base, what the container seeks by
+  int64_t pos; // byte position of the packet
+  int size;
+} SeekIndexEntry;
+
+typedef struct SeekIndex {
+  char *path;
+  int streamIndex;
+  AVRational time_base;
+
+  SDL_Mutex *mutex; // entries and count
+  SeekIndexEntry *entries;
+  int count;
+  int capacity;
+
+  SDL_Thread *thread;
+  volatile bool running;
+  SDL_AtomicInt complete; // the whole file was scanned
+
+  IndexCache *cache;         // entries point into it, when loaded from a cache
+  IndexCacheStreams streams; // written to the cache with the entries
+  bool saveCache;
+} SeekIndex;
+
+SeekIndex *seek_index_create(const char *path, int streamIndex,
+                             AVRational time_base);
+
+// takes the entries of a cache and owns it from then on, the index is
+// complete without a scan. Returns false if the cache doesn't fit.
+bool seek_index_adopt(SeekIndex *index, IndexCache *cache);
+
+// a finished scan is saved to the cache together with the stream summary
+void seek_index_set_cache_streams(SeekIndex *index,
+                                  const IndexCacheStreams *streams);
+
+// starts the background scan, unless the index is complete already
+bool seek_index_start(SeekIndex *index);
+
+// adds a keyframe, entries stay sorted by pts
+bool seek_index_add(SeekIndex *index, const SeekIndexEntry *entry);
+
+// the last keyframe at or before pts. Returns false if the index doesn't
+// reach pts yet, or there is no keyframe before it.
+bool seek_index_lookup(SeekIndex *index, int64_t pts, SeekIndexEntry *entry);
+
+bool seek_index_is_complete(SeekIndex *index);
+
+// stops the scan and frees everything
+void seek_index_destroy(SeekIndex *index);
+
+#endif
@@ -11,9 +11,38 @@ typedef struct Shader
   unsigned int ID; // OpenGL shader programm ID
 } Shader;
 
-// Creates a Shader Program that takes both vertex and fragmaent files as an
-// input
-Shader createShader(const char *vertexPath, const char *fragmentPath);
+// Creates a Shader Program from the vertex and fragment shader source code
+// (see shaderSources.h, generated from shader/ at build time). A program this
+// driver linked before is loaded from the cache directory instead.
+Shader createShader(const char *vertexSource, const char *fragmentSource);
+
+// the same, with defines put in after the #version line of both sources
+// ("#define NAME\n" lines, NULL for none). Used to build specialised
+// programs out of one source.
+Shader createShaderVariant(const char *vertexSource,
+                           const char *fragmentSource, const char *defines);
+
+#define SHADER_VARIANT_MAX 16
+
+// programs built from the same sources with different defines. A variant is
+// compiled (or loaded from the cache) the first time it is asked for, and
+// kept until deleteShaderVariants.
+typedef struct ShaderVariants
+{
+  const char *vertexSource;
+  const char *fragmentSource;
+  int count;
+  const char *defines[SHADER_VARIANT_MAX]; // not copied, string literals
+  Shader shaders[SHADER_VARIANT_MAX];
+} ShaderVariants;
+
+void initShaderVariants(ShaderVariants *variants, const char *vertexSource,
+                        const char *fragmentSource);
+
+// the program for defines, NULL if it doesn't compile
+const Shader *getShaderVariant(ShaderVariants *variants, const char *defines);
+
+void deleteShaderVariants(ShaderVariants *variants);
 
 // activates the shader programm.
 // Use this function while rendering. So in the main-while loop.
@@ -0,0 +1,63 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * Records where the time of every thread goes, "--trace <file>" turns it on.
+ * Each thread owns a ring of events, writing one is a few stores and one
+ * atomic, without locks or allocation. When a ring is full the oldest events
+ * are overwritten, so a dump always holds the last few seconds before it.
+ *
+ * The dump is a Chrome trace_event JSON file, open it in chrome://tracing or
+ * https://ui.perfetto.dev. It is written on exit and when "T" is pressed.
+ *
+ *   Uint64 start = trace_now();
+ *   sws_scale(...);
+ *   trace_event("sws_scale", start);
+ */
+
+// threads that can record at the same time
+#define TRACE_MAX_THREADS 16
+// events per thread, a power of two
+#define TRACE_RING_EVENTS 32768
+
+typedef struct TraceEvent {
+  const char *name; // a string literal, only the pointer is stored
+  Uint64 start;     // ns, SDL_GetTicksNS
+  Uint64 end;
+} TraceEvent;
+
+typedef struct TraceRing {
+  const char *threadName;
+  bool active;            // a thread is registered on this ring
+  SDL_AtomicU32 written;  // events ever written, only the owner writes
+  TraceEvent *events;     // TRACE_RING_EVENTS
+} TraceRing;
+
+// before any thread registers. Without it every trace call does nothing.
+void trace_init(void);
+
+// at the start of a thread, allocates its ring. A thread that registers with
+// the name of an earlier, already finished thread continues its ring.
+void trace_register_thread(const char *name);
+
+// at the end of a thread
+void trace_unregister_thread(void);
+
+// start time for trace_event, 0 if this thread doesn't record
+Uint64 trace_now(void);
+
+// records a span from start until now on the ring of this thread
+void trace_event(const char *name, Uint64 start);
+
+// writes all rings as Chrome trace_event JSON. Other threads keep recording,
+// events overwritten during the dump might be shown with the wrong times.
+bool trace_dump(const char *path);
+
+// after all recording threads finished
+void trace_shutdown(void);
+
+#endif
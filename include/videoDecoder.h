@@ -0,0 +1,97 @@
+#ifndef VIDEO_DECODER_H
+#define VIDEO_DECODER_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+
+#include "frameRing.h"
+#include "mediaLoader.h"
+#include "playbackClock.h"
+
+/**
+ * Decodes and converts video frames on its own thread, so a slow I-frame or
+ * a sws_scale spike never delays the render loop. Finished frames are
+ * published into the frame ring, the render loop picks the one that is due.
+ *
+ * When decoding falls behind the playback clock, frames that are already
+ * late are dropped right after decoding, before the transfer, sws_scale and
+ * the upload. If that keeps happening the decoder skips frames itself
+ * (skip_frame NONREF, then NONKEY) until it is ahead of the clock again.
+ * After a seek, frames before the seek target are dropped the same way.
+ */
+
+// late frames in a row before the decoder skips more frames
+#define VIDEO_SKIP_ESCALATE 5
+// frames in a row ahead of the clock before the decoder skips less again
+#define VIDEO_SKIP_DEESCALATE 3
+// longest sleep of the thread with nothing to do, it's woken up before
+#define VIDEO_DECODER_WAIT_MS 100
+
+typedef struct VideoDecoderStats {
+  int decoded;       // frames pushed into the ring
+  int droppedLate;   // late frames dropped before the conversion
+  int droppedRender; // frames the render loop dropped without uploading
+  int skipLevel;     // 0 all frames, 1 AVDISCARD_NONREF, 2 AVDISCARD_NONKEY
+  // hardware frames transferred into pooled buffers, and the buffers the
+  // pool had to allocate for them
+  int poolFrames;
+  int poolAllocations;
+} VideoDecoderStats;
+
+typedef struct VideoDecoder {
+  VideoContainer *video;
+  FrameRing *ring;
+  PlaybackClock *clock; // NULL, if nothing should be dropped
+  double frameDuration; // seconds, from the frame rate of the stream
+  SDL_Thread *thread;
+  volatile bool running;
+
+  // late frame policy, decode thread only
+  int lateStreak;
+  int aheadStreak;
+  int policySerial;
+
+  // frames before the target of an accurate seek, decode thread only
+  int trimSerial;
+  bool trimming;
+  double trimPts;
+
+  bool primed;            // the first writable slot holds a decoded frame
+  SDL_AtomicInt finished; // the file ended, nothing more to decode
+
+  SDL_AtomicInt skipLevel;
+  SDL_AtomicInt decoded;
+  SDL_AtomicInt droppedLate;
+  SDL_AtomicInt droppedRender;
+  SDL_AtomicInt poolFrames;
+  SDL_AtomicInt poolAllocations;
+} VideoDecoder;
+
+VideoDecoder *video_decoder_create(VideoContainer *video,
+                                   PlaybackClock *clock);
+
+// decodes the first frame before the thread runs, so a prefetched file
+// starts with a picture right away. Needs a started demuxer.
+bool video_decoder_prime(VideoDecoder *decoder);
+
+bool video_decoder_start(VideoDecoder *decoder);
+
+// the thread rechecks pause, seek and stop right away instead of sleeping
+// on. Call after unpausing and seeking.
+void video_decoder_wake(VideoDecoder *decoder);
+
+// the end of a file that doesn't loop was reached
+bool video_decoder_is_finished(VideoDecoder *decoder);
+
+// the demuxer has to be aborted first, otherwise the thread might wait for
+// packets forever.
+void video_decoder_stop(VideoDecoder *decoder);
+
+void video_decoder_destroy(VideoDecoder *decoder);
+
+// the render loop dropped a frame of the ring without uploading it
+void video_decoder_count_render_drop(VideoDecoder *decoder);
+
+void video_decoder_get_stats(VideoDecoder *decoder, VideoDecoderStats *stats);
+
+#endif
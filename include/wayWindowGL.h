@@ -9,6 +9,8 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+
+#include "glExtensions.h"
 // clang-format on
 
 // initiate a SDL3 window
@@ -1,10 +1,110 @@
 #version 410 core
+// The renderer defines one of PACKED_RGB, SEMI_PLANAR_YUV (Y + interleaved UV,
+// nv12 and p010) or PLANAR_YUV (Y + U + V, yuv420p, yuv444p and yuv420p10),
+// every upload format gets a program of its own without branches. 10-bit
+// formats add SAMPLE_SCALE and DITHER, HDR video TRANSFER_PQ or TRANSFER_HLG.
 in vec2 TexCoord;   // from vertex shader given coordinates
 out vec4 FragColor; // frament colors
 
-uniform sampler2D videoTexture; // video texture sampler
+uniform sampler2D videoTexture; // video texture sampler, RGB or the Y plane
+
+#ifndef PACKED_RGB
+uniform sampler2D planeU; // U plane, or the interleaved UV plane (nv12)
+#ifdef PLANAR_YUV
+uniform sampler2D planeV; // V plane
+#endif
+
+// Y'CbCr to RGB for BT.601/709/2020, limited range expansion included
+uniform mat3 yuvMatrix;
+uniform vec3 yuvOffset;
+#endif
+
+#if defined(TRANSFER_PQ) || defined(TRANSFER_HLG)
+// HDR is mapped so that diffuse white (BT.2408) becomes SDR white, highlights
+// up to HDR_PEAK_NITS are compressed into the rest
+const float SDR_WHITE_NITS = 203.0;
+const float HDR_PEAK_NITS = 1000.0;
+
+// BT.2020 to BT.709 primaries, both linear, column major
+const mat3 BT2020_TO_BT709 = mat3(1.6605, -0.1246, -0.0182,  //
+                                  -0.5876, 1.1329, -0.1006,  //
+                                  -0.0728, -0.0083, 1.1187); //
+
+#ifdef TRANSFER_PQ
+// SMPTE ST 2084 EOTF, the signal is absolute luminance
+vec3 toNits(vec3 signal) {
+  const float m1 = 0.1593017578125;
+  const float m2 = 78.84375;
+  const float c1 = 0.8359375;
+  const float c2 = 18.8515625;
+  const float c3 = 18.6875;
+  vec3 p = pow(signal, vec3(1.0 / m2));
+  return 10000.0 * pow(max(p - c1, 0.0) / (c2 - c3 * p), vec3(1.0 / m1));
+}
+#else
+// ARIB STD-B67 inverse OETF and the OOTF of a 1000 nit display (gamma 1.2)
+vec3 toNits(vec3 signal) {
+  const float a = 0.17883277;
+  const float b = 0.28466892;
+  const float c = 0.55991073;
+  vec3 scene = mix(signal * signal / 3.0, (exp((signal - c) / a) + b) / 12.0,
+                   step(0.5, signal));
+  float luma = dot(scene, vec3(0.2627, 0.6780, 0.0593));
+  return 1000.0 * pow(max(luma, 1e-6), 0.2) * scene;
+}
+#endif
+
+// linear up to a knee, above it extended Reinhard takes the peak to 1.0. It
+// works on the largest channel, so the hue stays.
+vec3 toneMap(vec3 nits) {
+  const float knee = 0.75;
+  const float peak = (HDR_PEAK_NITS / SDR_WHITE_NITS - knee) / (1.0 - knee);
+
+  vec3 rgb = max(BT2020_TO_BT709 * (nits / SDR_WHITE_NITS), 0.0);
+  float largest = max(max(rgb.r, rgb.g), rgb.b);
+  if (largest > knee) {
+    float t = (largest - knee) / (1.0 - knee);
+    t = t * (1.0 + t / (peak * peak)) / (1.0 + t);
+    rgb *= (knee + (1.0 - knee) * min(t, 1.0)) / largest;
+  }
+  // back to a gamma encoded SDR signal
+  return pow(rgb, vec3(1.0 / 2.2));
+}
+#endif
+
+#ifdef DITHER
+// interleaved gradient noise, breaks up the banding when 10 bits end up in
+// an 8-bit framebuffer
+float ditherNoise(vec2 position) {
+  return fract(52.9829189 *
+               fract(dot(position, vec2(0.06711056, 0.00583715))));
+}
+#endif
 
 void main() {
+#ifdef PACKED_RGB
   // reads the color from the texture and outputs it
   FragColor = texture(videoTexture, TexCoord);
+#else
+  vec3 yuv;
+  yuv.x = texture(videoTexture, TexCoord).r;
+#ifdef SEMI_PLANAR_YUV
+  yuv.yz = texture(planeU, TexCoord).rg;
+#else
+  yuv.y = texture(planeU, TexCoord).r;
+  yuv.z = texture(planeV, TexCoord).r;
+#endif
+#ifdef SAMPLE_SCALE
+  yuv *= SAMPLE_SCALE;
+#endif
+
+  vec3 rgb = clamp(yuvMatrix * (yuv - yuvOffset), 0.0, 1.0);
+#if defined(TRANSFER_PQ) || defined(TRANSFER_HLG)
+  rgb = toneMap(toNits(rgb));
+#endif
+#ifdef DITHER
+  rgb += (ditherNoise(gl_FragCoord.xy) - 0.5) / 255.0;
+#endif
+  FragColor = vec4(clamp(rgb, 0.0, 1.0), 1.0);
+#endif
 }
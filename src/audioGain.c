@@ -0,0 +1,122 @@
+#include "audioGain.h"
+
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                     \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define AUDIO_GAIN_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AUDIO_GAIN_NEON
+#endif
+
+static Uint32 float_bits(float value) {
+  Uint32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static float bits_float(Uint32 bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void audio_gain_init(AudioGain *gain, int sampleRate, float initial) {
+  SDL_SetAtomicU32(&gain->target, float_bits(initial));
+  gain->current = initial;
+  gain->rampTarget = initial;
+  gain->rampStep = 0.0f;
+  gain->rampLeft = 0;
+  gain->rampFrames = SDL_max(1, sampleRate * AUDIO_GAIN_RAMP_MS / 1000);
+}
+
+void audio_gain_set(AudioGain *gain, float target) {
+  SDL_SetAtomicU32(&gain->target, float_bits(SDL_max(target, 0.0f)));
+}
+
+float audio_gain_get(AudioGain *gain) {
+  return bits_float(SDL_GetAtomicU32(&gain->target));
+}
+
+// every sample times the same gain
+static void scale(float *samples, int count, float gain) {
+  int i = 0;
+#if defined(AUDIO_GAIN_SSE)
+  __m128 factor = _mm_set1_ps(gain);
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), factor));
+  }
+#elif defined(AUDIO_GAIN_NEON)
+  float32x4_t factor = vdupq_n_f32(gain);
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(samples + i, vmulq_f32(vld1q_f32(samples + i), factor));
+  }
+#endif
+  for (; i < count; i++) {
+    samples[i] *= gain;
+  }
+}
+
+// gain moves by step every sample frame, both channels of a frame get the
+// same gain
+static void ramp(float *samples, int frames, float gain, float step) {
+  int frame = 0;
+#if defined(AUDIO_GAIN_SSE)
+  // two frames per vector: L0 R0 L1 R1
+  __m128 factor = _mm_set_ps(gain + step, gain + step, gain, gain);
+  __m128 increment = _mm_set1_ps(2.0f * step);
+  for (; frame + 2 <= frames; frame += 2) {
+    float *at = samples + frame * 2;
+    _mm_storeu_ps(at, _mm_mul_ps(_mm_loadu_ps(at), factor));
+    factor = _mm_add_ps(factor, increment);
+  }
+  gain += frame * step;
+#elif defined(AUDIO_GAIN_NEON)
+  float lanes[4] = {gain, gain, gain + step, gain + step};
+  float32x4_t factor = vld1q_f32(lanes);
+  float32x4_t increment = vdupq_n_f32(2.0f * step);
+  for (; frame + 2 <= frames; frame += 2) {
+    float *at = samples + frame * 2;
+    vst1q_f32(at, vmulq_f32(vld1q_f32(at), factor));
+    factor = vaddq_f32(factor, increment);
+  }
+  gain += frame * step;
+#endif
+  for (; frame < frames; frame++) {
+    samples[frame * 2] *= gain;
+    samples[frame * 2 + 1] *= gain;
+    gain += step;
+  }
+}
+
+void audio_gain_apply(AudioGain *gain, float *samples, int frames) {
+  float target = audio_gain_get(gain);
+  if (target != gain->rampTarget) {
+    gain->rampTarget = target;
+    gain->rampLeft = gain->rampFrames;
+    gain->rampStep = (target - gain->current) / gain->rampFrames;
+  }
+
+  if (gain->rampLeft > 0) {
+    int frames_in_ramp = SDL_min(frames, gain->rampLeft);
+    ramp(samples, frames_in_ramp, gain->current, gain->rampStep);
+    gain->rampLeft -= frames_in_ramp;
+    // no rounding errors piling up, the ramp ends exactly on the target
+    gain->current = gain->rampLeft > 0
+                        ? gain->current + frames_in_ramp * gain->rampStep
+                        : gain->rampTarget;
+    samples += frames_in_ramp * 2;
+    frames -= frames_in_ramp;
+  }
+
+  if (frames <= 0 || gain->current == 1.0f) {
+    return;
+  }
+  if (gain->current == 0.0f) {
+    memset(samples, 0, (size_t)frames * 2 * sizeof(float));
+    return;
+  }
+  scale(samples, frames * 2, gain->current);
+}
@@ -1,56 +1,170 @@
 #include "audioManager.h"
 #include <stdlib.h>
+#include <string.h>
 
-// This is the audio thread function that continuously feeds audio data.
+// stereo F32, the format the resampler converts to
+#define AUDIO_BYTES_PER_SAMPLE (2 * (int)sizeof(float))
+
+// Called by SDL on the audio device thread whenever the stream needs more
+// data. Hands exactly the requested bytes from the PCM ring to the stream and
+// stamps the clock, whatever is missing is played as silence by SDL.
+static void SDLCALL audio_stream_callback(void *userdata,
+                                          SDL_AudioStream *stream,
+                                          int additional_amount,
+                                          int total_amount) {
+  (void)stream;
+  (void)total_amount;
+  AudioManager *am = (AudioManager *)userdata;
+
+  while (additional_amount > 0) {
+    uint8_t *data;
+    double endPts;
+    int serial;
+    int size =
+        pcm_ring_peek(am->ring, &data, additional_amount, &endPts, &serial);
+    if (size == 0) {
+      break;
+    }
+    am->starved = false;
+
+    // the bytes belong to the callback until they are consumed, the gain
+    // is applied in place. Silence while muted still moves the clock.
+    audio_gain_apply(&am->gain, (float *)data, size / AUDIO_BYTES_PER_SAMPLE);
+    if (!playback_clock_queue(&am->clock, data, size, endPts, serial)) {
+      SDL_Log("SDL_PutAudioStreamData error: %s", SDL_GetError());
+    }
+    pcm_ring_consume(am->ring, size);
+    additional_amount -= size;
+  }
+
+  // the device plays silence for the rest. Not an underrun at the end of
+  // the file or right after a seek, the decoder has nothing to give then.
+  if (additional_amount > 0 && !am->starved &&
+      SDL_GetAtomicInt(&am->feeding)) {
+    am->starved = true;
+    SDL_AddAtomicInt(&am->underruns, 1);
+  }
+}
+
+static int ms_to_bytes(AudioManager *am, int ms) {
+  int bytes = (int)((Sint64)am->ring->bytesPerSecond * ms / 1000);
+  return bytes - bytes % AUDIO_BYTES_PER_SAMPLE;
+}
+
+// decode thread: more buffer after underruns, less after a stable while
+static int update_buffer_target(AudioManager *am) {
+  int target = SDL_GetAtomicInt(&am->bufferTarget);
+  int underruns = SDL_GetAtomicInt(&am->underruns);
+  Uint64 now = SDL_GetTicksNS();
+
+  if (underruns != am->seenUnderruns) {
+    am->seenUnderruns = underruns;
+    int raised = SDL_min(target * 2, ms_to_bytes(am, AUDIO_BUFFER_MAX_MS));
+    if (raised != target) {
+      target = raised;
+      SDL_Log("Audio underrun (%d so far), buffering %.0f ms now.", underruns,
+              target * 1000.0 / am->ring->bytesPerSecond);
+    }
+    am->stableSince = now;
+  } else if (now - am->stableSince >=
+             (Uint64)AUDIO_BUFFER_STABLE_MS * SDL_NS_PER_MS) {
+    int lowered = target - target / 8;
+    lowered -= lowered % AUDIO_BYTES_PER_SAMPLE;
+    target = SDL_max(lowered, ms_to_bytes(am, AUDIO_BUFFER_MIN_MS));
+    am->stableSince = now;
+  }
+
+  SDL_SetAtomicInt(&am->bufferTarget, target);
+  return target;
+}
+
+// copies the staged samples into the PCM ring, waits for the callback when
+// the ring is full
+static void write_staged_samples(AudioManager *am, const aFrame *staging) {
+  int bytesPerSecond = am->ring->bytesPerSecond;
+  int offset = 0;
+
+  while (am->running && offset < staging->convertedDataSize) {
+    int space = pcm_ring_space(am->ring);
+    if (space < AUDIO_BYTES_PER_SAMPLE) {
+      pcm_ring_wait(am->ring, 100);
+      continue;
+    }
+
+    // whole samples only, the pts of every piece is where its last sample
+    // ends
+    int size = SDL_min(space, staging->convertedDataSize - offset);
+    size -= size % AUDIO_BYTES_PER_SAMPLE;
+    int remaining = staging->convertedDataSize - offset - size;
+    double endPts = staging->end_pts - (double)remaining / bytesPerSecond;
+
+    pcm_ring_write(am->ring, staging->convertedData + offset, size, endPts,
+                   staging->serial);
+    offset += size;
+  }
+}
+
+// This is the audio thread function. It decodes ahead into the PCM ring and
+// sleeps until the callback took data out of it.
 static int audio_thread_func(void *data) {
   AudioManager *am = (AudioManager *)data;
+  aFrame *staging = am->audioFrame;
+  trace_register_thread("AudioThread");
+  am->stableSince = SDL_GetTicksNS();
   while (am->running) {
-    int available = SDL_GetAudioStreamAvailable(am->audioStream);
-    if (available < am->buffer_threshold) {
-      if (audio_container_get_frame(am->audio, am->audioFrame)) {
-        int ret;
-        if (am->muted) {
-          // Allocate a temporary buffer filled with silence (0.0f for
-          // SDL_AUDIO_F32).
-          void *silence = calloc(1, am->audioFrame->convertedDataSize);
-          if (!silence) {
-            SDL_Log("Memory allocation for silence buffer failed.");
-            continue;
-          }
-          ret = SDL_PutAudioStreamData(am->audioStream, silence,
-                                       am->audioFrame->convertedDataSize);
-          free(silence);
-        } else {
-          ret = SDL_PutAudioStreamData(am->audioStream,
-                                       am->audioFrame->convertedData[0],
-                                       am->audioFrame->convertedDataSize);
-        }
-        if (ret < 0) {
-          SDL_Log("SDL_PutAudioStreamData error: %s", SDL_GetError());
-        }
-      } else {
-        // No more audio frames available.
-        am->running = false;
-        break;
+    int target = update_buffer_target(am);
+    int buffered = pcm_ring_buffered(am->ring);
+    if (buffered >= target) {
+      pcm_ring_wait(am->ring, 100);
+      continue;
+    }
+
+    Uint64 traceStart = trace_now();
+    int ret = audio_container_decode_samples(am->audio, staging,
+                                             target - buffered);
+    if (ret > 0) {
+      // after a seek the callback skips what is still in the ring, an empty
+      // ring is no underrun until the new samples are in
+      if (staging->serial != am->ringSerial) {
+        SDL_SetAtomicInt(&am->feeding, 0);
+        pcm_ring_discard(am->ring);
+        am->ringSerial = staging->serial;
       }
+      write_staged_samples(am, staging);
+      SDL_SetAtomicInt(&am->feeding, 1);
     } else {
+      SDL_SetAtomicInt(&am->feeding, 0);
+
+      // No more audio frames available, the file ended without looping.
+      // Wait for a seek.
       SDL_Delay(5);
     }
+    trace_event("audio iteration", traceStart);
   }
+  trace_unregister_thread();
   return 0;
 }
 
-int audio_manager_init(AudioManager *am, const char *filepath) {
+int audio_manager_init(AudioManager *am, Demuxer *demuxer) {
   // Initialize FFmpeg audio container and frames.
-  am->audio = init_audio_container(filepath);
-  if (!am->audio) {
+  AudioContainer *audio = init_audio_container(demuxer);
+  if (!audio) {
     SDL_Log("Failed to initialize audio container.");
     return -1;
   }
+  return audio_manager_init_container(am, audio);
+}
+
+int audio_manager_init_container(AudioManager *am, AudioContainer *audio) {
+  am->ring = NULL;
+  am->audioStream = NULL;
+  am->audio = audio;
+
   am->audioFrame = init_audio_frames(am->audio);
   if (!am->audioFrame) {
     SDL_Log("Failed to initialize audio frames.");
     free_audio_data(am->audio);
+    am->audio = NULL;
     return -1;
   }
 
@@ -60,20 +174,50 @@ int audio_manager_init(AudioManager *am, const char *filepath) {
   audioSpec.format = SDL_AUDIO_F32; // 32-bit float samples.
   audioSpec.freq = am->audio->pCodecCtx->sample_rate;
 
-  am->audioStream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK,
-                                              &audioSpec, NULL, NULL);
-  if (!am->audioStream) {
-    SDL_Log("Failed to open audio stream: %s", SDL_GetError());
+  // one second of decoded audio at most, the decode thread keeps
+  // bufferTarget bytes of it filled
+  int bytesPerSecond = audioSpec.freq * AUDIO_BYTES_PER_SAMPLE;
+  am->ring = pcm_ring_create(bytesPerSecond, bytesPerSecond);
+  if (!am->ring) {
     free_audio_frames(am->audioFrame);
+    am->audioFrame = NULL;
     free_audio_data(am->audio);
+    am->audio = NULL;
     return -1;
   }
-  SDL_ResumeAudioStreamDevice(am->audioStream);
+  am->ringSerial = -1;
 
-  am->buffer_threshold = 16384; // This threshold worked well
+  // the same time on every sample rate, adapted while playing
+  SDL_SetAtomicInt(&am->bufferTarget, ms_to_bytes(am, AUDIO_BUFFER_START_MS));
+  SDL_SetAtomicInt(&am->underruns, 0);
+  SDL_SetAtomicInt(&am->feeding, 0);
+  am->starved = false;
+  am->seenUnderruns = 0;
+  am->stableSince = 0;
   am->running = false;
   am->audioThread = NULL;
   am->muted = false; // Initialer Zustand: nicht stumm.
+  am->volume = 1.0f;
+  audio_gain_init(&am->gain, audioSpec.freq, am->volume);
+
+  // the device starts paused, the callback pulls from the ring once resumed
+  am->audioStream = SDL_OpenAudioDeviceStream(
+      SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &audioSpec, audio_stream_callback, am);
+  if (!am->audioStream) {
+    SDL_Log("Failed to open audio stream: %s", SDL_GetError());
+    pcm_ring_destroy(am->ring);
+    am->ring = NULL;
+    free_audio_frames(am->audioFrame);
+    am->audioFrame = NULL;
+    free_audio_data(am->audio);
+    am->audio = NULL;
+    return -1;
+  }
+
+  // every queued chunk gets stamped with its pts, stereo F32 like above
+  playback_clock_init(&am->clock, am->audioStream, audioSpec.freq,
+                      audioSpec.channels, sizeof(float));
+  SDL_ResumeAudioStreamDevice(am->audioStream);
 
   return 0;
 }
@@ -89,17 +233,58 @@ void audio_manager_start(AudioManager *am) {
 
 void audio_manager_stop(AudioManager *am) {
   am->running = false;
+  if (am->ring) {
+    pcm_ring_wake(am->ring);
+  }
   if (am->audioThread) {
     SDL_WaitThread(am->audioThread, NULL);
     am->audioThread = NULL;
   }
 }
 
+void audio_manager_set_muted(AudioManager *am, bool muted) {
+  am->muted = muted;
+  audio_gain_set(&am->gain, muted ? 0.0f : am->volume);
+}
+
+void audio_manager_change_volume(AudioManager *am, float delta) {
+  am->volume = SDL_clamp(am->volume + delta, 0.0f, 1.0f);
+  if (!am->muted) {
+    audio_gain_set(&am->gain, am->volume);
+  }
+  SDL_Log("Volume %.0f%%%s", am->volume * 100.0f, am->muted ? " (muted)" : "");
+}
+
+void audio_manager_get_stats(AudioManager *am, AudioManagerStats *stats) {
+  // nothing to report after a failed init
+  double bytesPerSecond =
+      am->ring && am->audioStream ? am->ring->bytesPerSecond : 0.0;
+  if (bytesPerSecond <= 0.0) {
+    SDL_zerop(stats);
+    return;
+  }
+
+  stats->underruns = SDL_GetAtomicInt(&am->underruns);
+  stats->targetMs =
+      SDL_GetAtomicInt(&am->bufferTarget) * 1000.0 / bytesPerSecond;
+  stats->bufferedMs = pcm_ring_buffered(am->ring) * 1000.0 / bytesPerSecond;
+  stats->latencyMs = stats->bufferedMs + am->clock.latency * 1000.0;
+}
+
 void audio_manager_cleanup(AudioManager *am) {
+  // stops the callback before the ring goes away
+  if (am->audioStream) {
+    SDL_DestroyAudioStream(am->audioStream);
+    am->audioStream = NULL;
+  }
+  pcm_ring_destroy(am->ring);
+  am->ring = NULL;
   if (am->audioFrame) {
     free_audio_frames(am->audioFrame);
+    am->audioFrame = NULL;
   }
   if (am->audio) {
     free_audio_data(am->audio);
+    am->audio = NULL;
   }
 }
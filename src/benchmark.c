@@ -0,0 +1,305 @@
+#include "benchmark.h"
+
+// packets kept in the queue, so decoding never waits for the file
+#define BENCH_QUEUED_PACKETS 16
+
+typedef enum BenchStage {
+  STAGE_DEMUX,
+  STAGE_DECODE,
+  STAGE_CONVERT,
+  STAGE_UPLOAD,
+  STAGE_DRAW,
+  STAGE_COUNT
+} BenchStage;
+
+static const char *stageNames[STAGE_COUNT] = {"demux", "decode", "convert",
+                                              "upload", "draw"};
+
+typedef struct StageSamples {
+  Uint64 *ns;
+  int count;
+  int capacity;
+} StageSamples;
+
+static void add_sample(StageSamples *samples, Uint64 ns) {
+  if (samples->count == samples->capacity) {
+    int capacity = samples->capacity ? samples->capacity * 2 : 1024;
+    Uint64 *grown = (Uint64 *)realloc(samples->ns, capacity * sizeof(Uint64));
+    if (!grown) {
+      return;
+    }
+    samples->ns = grown;
+    samples->capacity = capacity;
+  }
+  samples->ns[samples->count++] = ns;
+}
+
+static int compare_samples(const void *a, const void *b) {
+  Uint64 x = *(const Uint64 *)a;
+  Uint64 y = *(const Uint64 *)b;
+  return (x > y) - (x < y);
+}
+
+// nearest rank percentile of sorted samples, in milliseconds
+static double percentile_ms(const StageSamples *samples, int percent) {
+  if (samples->count == 0) {
+    return 0.0;
+  }
+  int index = (samples->count * percent + 99) / 100 - 1;
+  if (index < 0) {
+    index = 0;
+  }
+  return samples->ns[index] / 1e6;
+}
+
+// JSON strings can't hold quotes, backslashes and control characters as is
+static void print_json_string(const char *text) {
+  putchar('"');
+  for (const char *c = text; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      printf("\\%c", *c);
+    } else if ((unsigned char)*c < 0x20) {
+      printf("\\u%04x", (unsigned char)*c);
+    } else {
+      putchar(*c);
+    }
+  }
+  putchar('"');
+}
+
+static void print_report(const BenchmarkOptions *options, int width,
+                         int height, enum AVPixelFormat uploadFormat,
+                         Renderer *renderer, StageSamples *samples,
+                         const GpuTimerStats *gpuStats, int frames,
+                         double seconds) {
+
+  double fps = seconds > 0.0 ? frames / seconds : 0.0;
+  const char *glRenderer = (const char *)glGetString(GL_RENDERER);
+  const char *format = av_get_pix_fmt_name(uploadFormat);
+  const char *upload = uploadModeName(renderer->config.uploadMode);
+
+  if (options->json) {
+    printf("{\n  \"file\": ");
+    print_json_string(options->path);
+    printf(",\n  \"width\": %d,\n  \"height\": %d,\n", width, height);
+    printf("  \"format\": ");
+    print_json_string(format ? format : "unknown");
+    printf(",\n  \"upload\": \"%s\",\n  \"pbo_depth\": %d,\n", upload,
+           renderer->config.pboDepth);
+    printf("  \"gl_renderer\": ");
+    print_json_string(glRenderer ? glRenderer : "unknown");
+    printf(",\n  \"frames\": %d,\n  \"seconds\": %.3f,\n  \"fps\": %.2f,\n",
+           frames, seconds, fps);
+    printf("  \"stages\": {\n");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+      printf("    \"%s\": {\"count\": %d, \"p50_ms\": %.3f, \"p95_ms\": %.3f, "
+             "\"p99_ms\": %.3f}%s\n",
+             stageNames[i], samples[i].count, percentile_ms(&samples[i], 50),
+             percentile_ms(&samples[i], 95), percentile_ms(&samples[i], 99),
+             i + 1 < STAGE_COUNT ? "," : "");
+    }
+    printf("  },\n  \"gpu\": {\n");
+    for (int i = 0; i < GPU_STAGE_COUNT; i++) {
+      printf("    \"%s\": {\"count\": %d, \"p50_ms\": %.1f, \"p95_ms\": %.1f, "
+             "\"p99_ms\": %.1f, \"max_ms\": %.3f, \"skipped\": %d}%s\n",
+             gpuTimerStageName((GpuTimerStage)i), gpuStats[i].count,
+             gpuStats[i].p50Ms, gpuStats[i].p95Ms, gpuStats[i].p99Ms,
+             gpuStats[i].maxMs, gpuStats[i].skipped,
+             i + 1 < GPU_STAGE_COUNT ? "," : "");
+    }
+    printf("  }\n}\n");
+    return;
+  }
+
+  printf("LunaScape benchmark\n");
+  printf("file:     %s\n", options->path);
+  printf("video:    %dx%d %s, upload %s (pbo depth %d)\n", width, height,
+         format ? format : "unknown", upload, renderer->config.pboDepth);
+  printf("renderer: %s\n", glRenderer ? glRenderer : "unknown");
+  printf("frames:   %d in %.3f s, %.2f fps\n\n", frames, seconds, fps);
+  printf("%-8s %8s %9s %9s %9s\n", "stage", "count", "p50 ms", "p95 ms",
+         "p99 ms");
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    printf("%-8s %8d %9.3f %9.3f %9.3f\n", stageNames[i], samples[i].count,
+           percentile_ms(&samples[i], 50), percentile_ms(&samples[i], 95),
+           percentile_ms(&samples[i], 99));
+  }
+
+  // from the timer queries, 0.1 ms resolution over the last frames
+  printf("\n%-8s %8s %9s %9s %9s %9s\n", "gpu", "count", "p50 ms", "p95 ms",
+         "p99 ms", "max ms");
+  for (int i = 0; i < GPU_STAGE_COUNT; i++) {
+    printf("%-8s %8d %9.1f %9.1f %9.1f %9.3f\n",
+           gpuTimerStageName((GpuTimerStage)i), gpuStats[i].count,
+           gpuStats[i].p50Ms, gpuStats[i].p95Ms, gpuStats[i].p99Ms,
+           gpuStats[i].maxMs);
+  }
+}
+
+int run_benchmark(const BenchmarkOptions *options) {
+
+  // no display and no sound device needed, has to be set before SDL_Init
+  SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+  SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+
+  Demuxer *demuxer = demuxer_open(options->path);
+  if (!demuxer) {
+    SDL_Log("Benchmark: failed to open %s", options->path);
+    return -1;
+  }
+
+  // audio is not decoded, its packets are not even read
+  if (demuxer->audioStreamIndex >= 0) {
+    demuxer->pFormatCtx->streams[demuxer->audioStreamIndex]->discard =
+        AVDISCARD_ALL;
+    demuxer->audioStreamIndex = -1;
+  }
+
+  VideoContainer *video = init_video_container(demuxer, false);
+  if (!video) {
+    SDL_Log("Benchmark: failed to init video");
+    demuxer_close(demuxer);
+    return -1;
+  }
+
+  int width = video->pCodecCtx->width;
+  int height = video->pCodecCtx->height;
+
+  SDL_Window *window =
+      initWayWindowGL("LunaScape benchmark", "0.1", width, height, false);
+  if (!window) {
+    free_video_data(video);
+    demuxer_close(demuxer);
+    return -1;
+  }
+
+  SDL_GLContext glContext = initOpenGLContext_and_glad(window);
+  if (!glContext) {
+    free_video_data(video);
+    demuxer_close(demuxer);
+    return -1;
+  }
+
+  Renderer renderer;
+  initRenderer(&renderer, width, height, video->upload_fmt,
+               &options->rendererConfig);
+  updateVideoTranformation(&renderer, width, height, width, height);
+
+  // as fast as possible, no vsync
+  SDL_GL_SetSwapInterval(0);
+
+  // the same ring and PBO slots as in playback, only without the threads
+  FrameRing *ring = frame_ring_create(video);
+  AVPacket *packet = av_packet_alloc();
+  if (!ring || !packet) {
+    SDL_Log("Benchmark: Memory allocation error.");
+    frame_ring_destroy(ring);
+    av_packet_free(&packet);
+    cleanupRenderer(&renderer);
+    free_video_data(video);
+    demuxer_close(demuxer);
+    releaseRendererShaders();
+    cleanupWindow(window, glContext);
+    return -1;
+  }
+  attachFrameRing(&renderer, ring);
+
+  StageSamples samples[STAGE_COUNT] = {0};
+  bool eof = false;
+  int frames = 0;
+  Uint64 benchStart = SDL_GetTicksNS();
+
+  while (options->maxFrames <= 0 || frames < options->maxFrames) {
+
+    while (!eof &&
+           packet_queue_count(&demuxer->videoQueue) < BENCH_QUEUED_PACKETS) {
+      Uint64 start = SDL_GetTicksNS();
+      eof = demuxer_read_packet(demuxer, packet) == 0;
+      if (!eof) {
+        add_sample(&samples[STAGE_DEMUX], SDL_GetTicksNS() - start);
+      }
+    }
+
+    // every slot still waits for its upload, the wait belongs to the upload
+    // of this frame
+    Uint64 uploadWait = 0;
+    vFrame *slot = frame_ring_peek_writable(ring);
+    if (!slot) {
+      Uint64 start = SDL_GetTicksNS();
+      waitFrameUpload(&renderer, frame_ring_peek_held(ring));
+      frame_ring_release(ring);
+      uploadWait = SDL_GetTicksNS() - start;
+      slot = frame_ring_peek_writable(ring);
+    }
+
+    Uint64 start = SDL_GetTicksNS();
+    int ret = video_container_decode_frame(video, slot);
+    if (ret <= 0) {
+      break;
+    }
+    add_sample(&samples[STAGE_DECODE], SDL_GetTicksNS() - start);
+
+    start = SDL_GetTicksNS();
+    bool converted = video_container_convert_frame(video, slot);
+    add_sample(&samples[STAGE_CONVERT], SDL_GetTicksNS() - start);
+    if (!converted) {
+      continue;
+    }
+    frame_ring_push(ring);
+
+    vFrame *videoFrame = frame_ring_peek(ring);
+    start = SDL_GetTicksNS();
+    uploadVideoFrame(&renderer, videoFrame);
+    add_sample(&samples[STAGE_UPLOAD], SDL_GetTicksNS() - start + uploadWait);
+
+    start = SDL_GetTicksNS();
+    renderFrameWithoutUpdate(&renderer);
+    Uint64 traceStart = trace_now();
+    SDL_GL_SwapWindow(window);
+    trace_event("SDL_GL_SwapWindow", traceStart);
+    add_sample(&samples[STAGE_DRAW], SDL_GetTicksNS() - start);
+
+    if (videoFrame->uploadSlot >= 0) {
+      frame_ring_advance(ring);
+    } else {
+      frame_ring_pop(ring);
+    }
+    frames++;
+  }
+
+  // the frames only count when the GPU is done with them
+  glFinish();
+  double seconds = (double)(SDL_GetTicksNS() - benchStart) / 1e9;
+
+  // after glFinish every timer query has its result
+  advanceGpuTimer(&renderer.gpuTimer);
+  GpuTimerStats gpuStats[GPU_STAGE_COUNT];
+  for (int i = 0; i < GPU_STAGE_COUNT; i++) {
+    getGpuTimerStats(&renderer.gpuTimer, (GpuTimerStage)i, &gpuStats[i]);
+  }
+
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    if (samples[i].count > 0) {
+      qsort(samples[i].ns, samples[i].count, sizeof(Uint64), compare_samples);
+    }
+  }
+  // freed before the report, so their log lines don't end up in the middle
+  // of it. The GL context is still needed for the renderer string.
+  enum AVPixelFormat uploadFormat = video->upload_fmt;
+  av_packet_free(&packet);
+  frame_ring_destroy(ring);
+  cleanupRenderer(&renderer);
+  free_video_data(video);
+  demuxer_close(demuxer);
+
+  print_report(options, width, height, uploadFormat, &renderer, samples,
+               gpuStats, frames, seconds);
+
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    free(samples[i].ns);
+  }
+  releaseRendererShaders();
+  cleanupWindow(window, glContext);
+
+  return frames > 0 ? 0 : -1;
+}
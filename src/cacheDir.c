@@ -0,0 +1,35 @@
+#include "cacheDir.h"
+
+bool cache_directory(const char *name, char *dir, size_t size) {
+  const char *cacheHome = getenv("XDG_CACHE_HOME");
+  int written;
+  if (cacheHome && cacheHome[0] == '/') {
+    written = snprintf(dir, size, "%s/LunaScape", cacheHome);
+  } else {
+    const char *home = getenv("HOME");
+    if (!home) {
+      return false;
+    }
+    written = snprintf(dir, size, "%s/.cache/LunaScape", home);
+  }
+  if (written < 0 || written >= (int)size) {
+    return false;
+  }
+
+  if (name) {
+    int appended = snprintf(dir + written, size - written, "/%s", name);
+    if (appended < 0 || appended >= (int)size - written) {
+      return false;
+    }
+  }
+  return SDL_CreateDirectory(dir);
+}
+
+uint64_t cache_hash(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
@@ -0,0 +1,403 @@
+#include "demuxer.h"
+
+// all active queues have enough data, or one of them hit its memory limit
+static bool demuxer_queues_full(Demuxer *demuxer) {
+  bool videoFull = demuxer->videoStreamIndex < 0 ||
+                   packet_queue_is_full(&demuxer->videoQueue);
+  bool audioFull = demuxer->audioStreamIndex < 0 ||
+                   packet_queue_is_full(&demuxer->audioQueue);
+
+  if (videoFull && audioFull) {
+    return true;
+  }
+
+  // a stream with bad interleaving should not eat up all the memory
+  return packet_queue_size(&demuxer->videoQueue) >
+             demuxer->videoQueue.max_bytes ||
+         packet_queue_size(&demuxer->audioQueue) >
+             demuxer->audioQueue.max_bytes;
+}
+
+static void demuxer_do_seek(Demuxer *demuxer, double seconds, SeekMode mode) {
+  bool targetValid = mode == SEEK_ACCURATE;
+  double target = seconds;
+  int ret = -1;
+
+  if (demuxer->videoStreamIndex >= 0) {
+    AVRational time_base =
+        demuxer->pFormatCtx->streams[demuxer->videoStreamIndex]->time_base;
+    int64_t ts = (int64_t)(seconds / av_q2d(time_base));
+
+    // the index knows the keyframe, the container seeks by dts. The
+    // container's own index is left alone, its entries are more than
+    // timestamps for some demuxers (the sample table of MP4).
+    SeekIndexEntry key;
+    if (demuxer->index && seek_index_lookup(demuxer->index, ts, &key)) {
+      if (mode == SEEK_FAST) {
+        target = key.pts * av_q2d(time_base);
+        targetValid = true;
+      }
+      ret = av_seek_frame(demuxer->pFormatCtx, demuxer->videoStreamIndex,
+                          key.dts, AVSEEK_FLAG_BACKWARD);
+      if (ret < 0 &&
+          !(demuxer->pFormatCtx->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+        ret = av_seek_frame(demuxer->pFormatCtx, demuxer->videoStreamIndex,
+                            key.pos, AVSEEK_FLAG_BYTE);
+      }
+    }
+    if (ret < 0) {
+      ret = av_seek_frame(demuxer->pFormatCtx, demuxer->videoStreamIndex, ts,
+                          AVSEEK_FLAG_BACKWARD);
+    }
+  }
+
+  // no video, or before the first keyframe of it
+  if (ret < 0) {
+    ret = av_seek_frame(demuxer->pFormatCtx, -1,
+                        (int64_t)(seconds * AV_TIME_BASE),
+                        AVSEEK_FLAG_BACKWARD);
+  }
+  if (ret < 0) {
+    fprintf(stderr, "Demuxer - seek failed.\n");
+  }
+
+  // the serial of both queues changes, the decoders flush themselves when
+  // they see the first packet after the seek.
+  packet_queue_flush(&demuxer->videoQueue);
+  packet_queue_flush(&demuxer->audioQueue);
+  demuxer->eof = false;
+
+  // the decoders start over with the new serial, timestamps as in the file
+  demuxer->loop_offset = 0;
+  demuxer->pass_end = 0;
+
+  demuxer->seek_target_valid = targetValid;
+  demuxer->seek_target = target;
+  demuxer->seek_video_serial = packet_queue_serial(&demuxer->videoQueue);
+  demuxer->seek_audio_serial = packet_queue_serial(&demuxer->audioQueue);
+}
+
+// back to the start of the file without a flush, the next pass continues
+// the timestamps of this one
+static bool demuxer_restart_loop(Demuxer *demuxer) {
+  int64_t start = demuxer->pFormatCtx->start_time == AV_NOPTS_VALUE
+                      ? 0
+                      : demuxer->pFormatCtx->start_time;
+  if (demuxer->pass_end <= start + demuxer->loop_offset ||
+      av_seek_frame(demuxer->pFormatCtx, -1, start, AVSEEK_FLAG_BACKWARD) <
+          0) {
+    return false;
+  }
+
+  // the decoders drain everything of this pass before the next one
+  if (demuxer->videoStreamIndex >= 0) {
+    packet_queue_put_loop(&demuxer->videoQueue);
+  }
+  if (demuxer->audioStreamIndex >= 0) {
+    packet_queue_put_loop(&demuxer->audioQueue);
+  }
+
+  SDL_LockMutex(demuxer->mutex);
+  demuxer->loop_length = demuxer->pass_end - start - demuxer->loop_offset;
+  demuxer->loop_offset = demuxer->pass_end - start;
+  SDL_UnlockMutex(demuxer->mutex);
+  return true;
+}
+
+// shifts the packet into the current pass and remembers where the pass ends
+static void demuxer_shift_packet(Demuxer *demuxer, AVPacket *packet) {
+  AVRational time_base =
+      demuxer->pFormatCtx->streams[packet->stream_index]->time_base;
+
+  if (demuxer->loop_offset != 0) {
+    int64_t offset =
+        av_rescale_q(demuxer->loop_offset, AV_TIME_BASE_Q, time_base);
+    if (packet->pts != AV_NOPTS_VALUE) {
+      packet->pts += offset;
+    }
+    if (packet->dts != AV_NOPTS_VALUE) {
+      packet->dts += offset;
+    }
+  }
+
+  int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+  if (pts != AV_NOPTS_VALUE) {
+    int64_t end =
+        av_rescale_q(pts + packet->duration, time_base, AV_TIME_BASE_Q);
+    demuxer->pass_end = SDL_max(demuxer->pass_end, end);
+  }
+}
+
+int demuxer_read_packet(Demuxer *demuxer, AVPacket *packet) {
+  Uint64 traceStart = trace_now();
+  int ret = av_read_frame(demuxer->pFormatCtx, packet);
+  trace_event("demux", traceStart);
+  if (ret < 0 && demuxer->loop && demuxer_restart_loop(demuxer)) {
+    return 1;
+  }
+  if (ret < 0) {
+    // end of file (or a read error), tell the decoders there is nothing
+    // more to come
+    packet_queue_set_eof(&demuxer->videoQueue, true);
+    packet_queue_set_eof(&demuxer->audioQueue, true);
+    demuxer->eof = true;
+    return 0;
+  }
+
+  if (packet->stream_index == demuxer->videoStreamIndex ||
+      packet->stream_index == demuxer->audioStreamIndex) {
+    demuxer_shift_packet(demuxer, packet);
+  }
+
+  if (packet->stream_index == demuxer->videoStreamIndex) {
+    packet_queue_put(&demuxer->videoQueue, packet);
+  } else if (packet->stream_index == demuxer->audioStreamIndex) {
+    packet_queue_put(&demuxer->audioQueue, packet);
+  } else {
+    av_packet_unref(packet);
+  }
+  return 1;
+}
+
+static int demux_thread_func(void *data) {
+  Demuxer *demuxer = (Demuxer *)data;
+
+  AVPacket *packet = av_packet_alloc();
+  if (!packet) {
+    fprintf(stderr, "Demuxer - could not allocate packet.\n");
+    return -1;
+  }
+  trace_register_thread("DemuxThread");
+
+  while (demuxer->running) {
+
+    SDL_LockMutex(demuxer->mutex);
+    if (demuxer->seek_req) {
+      demuxer_do_seek(demuxer, demuxer->seek_seconds, demuxer->seek_mode);
+      demuxer->seek_req = false;
+    }
+
+    // nothing to do, wait until a decoder consumed packets or a seek request
+    // comes in. Both signal cond, the timeout is only a safety net.
+    if (demuxer->eof || demuxer_queues_full(demuxer)) {
+      SDL_WaitConditionTimeout(demuxer->cond, demuxer->mutex,
+                               DEMUXER_WAIT_MS);
+      SDL_UnlockMutex(demuxer->mutex);
+      continue;
+    }
+    SDL_UnlockMutex(demuxer->mutex);
+
+    demuxer_read_packet(demuxer, packet);
+  }
+
+  av_packet_free(&packet);
+  trace_unregister_thread();
+  return 0;
+}
+
+Demuxer *demuxer_open(const char *filepath) {
+
+  Demuxer *demuxer = (Demuxer *)calloc(1, sizeof(Demuxer));
+  if (!demuxer) {
+    fprintf(stderr, "Demuxer - Memory allocation error.\n");
+    return NULL;
+  }
+
+  demuxer->videoStreamIndex = -1;
+  demuxer->audioStreamIndex = -1;
+
+  AVDictionary *options = NULL;
+  av_dict_set_int(&options, "probesize", DEMUXER_PROBE_SIZE, 0);
+  av_dict_set_int(&options, "analyzeduration", DEMUXER_ANALYZE_DURATION, 0);
+  int ret = avformat_open_input(&demuxer->pFormatCtx, filepath, NULL, &options);
+  av_dict_free(&options);
+  if (ret != 0) {
+    fprintf(stderr, "Could not open file.\n");
+    free(demuxer);
+    return NULL;
+  }
+
+  // a file played before has a sidecar with everything probing would find,
+  // and its keyframe index
+  IndexCache *cache = index_cache_open(filepath);
+  bool cached = cache && index_cache_apply(cache, demuxer->pFormatCtx);
+  if (cached) {
+    SDL_Log("Using the cached index, the file is not probed.");
+  } else if (avformat_find_stream_info(demuxer->pFormatCtx, NULL) < 0) {
+    fprintf(stderr, "Could not find any stream-information.\n");
+    index_cache_close(cache);
+    avformat_close_input(&demuxer->pFormatCtx);
+    free(demuxer);
+    return NULL;
+  }
+
+  // first video and first audio stream, everything else is not even demuxed
+  for (unsigned int i = 0; i < demuxer->pFormatCtx->nb_streams; i++) {
+    AVStream *stream = demuxer->pFormatCtx->streams[i];
+    enum AVMediaType type = stream->codecpar->codec_type;
+
+    if (type == AVMEDIA_TYPE_VIDEO && demuxer->videoStreamIndex == -1) {
+      demuxer->videoStreamIndex = i;
+    } else if (type == AVMEDIA_TYPE_AUDIO && demuxer->audioStreamIndex == -1) {
+      demuxer->audioStreamIndex = i;
+    } else {
+      stream->discard = AVDISCARD_ALL;
+    }
+  }
+
+  AVRational videoTimeBase = {1, 1};
+  AVRational audioTimeBase = {1, 1};
+  if (demuxer->videoStreamIndex >= 0) {
+    videoTimeBase =
+        demuxer->pFormatCtx->streams[demuxer->videoStreamIndex]->time_base;
+  }
+  if (demuxer->audioStreamIndex >= 0) {
+    audioTimeBase =
+        demuxer->pFormatCtx->streams[demuxer->audioStreamIndex]->time_base;
+  }
+
+  demuxer->mutex = SDL_CreateMutex();
+  demuxer->cond = SDL_CreateCondition();
+
+  if (!demuxer->mutex || !demuxer->cond ||
+      packet_queue_init(&demuxer->videoQueue, videoTimeBase,
+                        DEMUXER_VIDEO_MAX_BYTES, DEMUXER_MAX_DURATION) < 0 ||
+      packet_queue_init(&demuxer->audioQueue, audioTimeBase,
+                        DEMUXER_AUDIO_MAX_BYTES, DEMUXER_MAX_DURATION) < 0) {
+    fprintf(stderr, "Demuxer - could not create synchronization objects.\n");
+    index_cache_close(cache);
+    demuxer_close(demuxer);
+    return NULL;
+  }
+  packet_queue_set_producer(&demuxer->videoQueue, demuxer->mutex,
+                            demuxer->cond);
+  packet_queue_set_producer(&demuxer->audioQueue, demuxer->mutex,
+                            demuxer->cond);
+
+  // only built once the thread starts, the benchmark never seeks
+  if (demuxer->videoStreamIndex >= 0) {
+    demuxer->index = seek_index_create(filepath, demuxer->videoStreamIndex,
+                                       videoTimeBase);
+  }
+  if (demuxer->index) {
+    IndexCacheStreams streams;
+    index_cache_describe(demuxer->pFormatCtx, demuxer->videoStreamIndex,
+                         demuxer->audioStreamIndex, &streams);
+    seek_index_set_cache_streams(demuxer->index, &streams);
+
+    if (cache && seek_index_adopt(demuxer->index, cache)) {
+      cache = NULL;
+    }
+  }
+  index_cache_close(cache);
+
+  return demuxer;
+}
+
+bool demuxer_start(Demuxer *demuxer) {
+  demuxer->running = true;
+  demuxer->thread = SDL_CreateThread(demux_thread_func, "DemuxThread", demuxer);
+  if (!demuxer->thread) {
+    SDL_Log("Failed to create demuxer thread: %s", SDL_GetError());
+    demuxer->running = false;
+    return false;
+  }
+
+  // without the index seeking still works, only slower
+  if (demuxer->index) {
+    seek_index_start(demuxer->index);
+  }
+
+  return true;
+}
+
+void demuxer_seek(Demuxer *demuxer, double seconds, SeekMode mode) {
+  SDL_LockMutex(demuxer->mutex);
+  demuxer->seek_seconds = SDL_max(seconds, 0.0);
+  demuxer->seek_mode = mode;
+  demuxer->seek_req = true;
+  SDL_SignalCondition(demuxer->cond);
+  SDL_UnlockMutex(demuxer->mutex);
+}
+
+bool demuxer_get_seek_target(Demuxer *demuxer, PacketQueue *queue, int serial,
+                             double *target) {
+  SDL_LockMutex(demuxer->mutex);
+  int seekSerial = queue == &demuxer->videoQueue ? demuxer->seek_video_serial
+                                                 : demuxer->seek_audio_serial;
+  bool valid = demuxer->seek_target_valid && serial == seekSerial;
+  if (valid) {
+    *target = demuxer->seek_target;
+  }
+  SDL_UnlockMutex(demuxer->mutex);
+  return valid;
+}
+
+double demuxer_file_position(Demuxer *demuxer, double seconds) {
+  SDL_LockMutex(demuxer->mutex);
+  double length = (double)demuxer->loop_length / AV_TIME_BASE;
+  SDL_UnlockMutex(demuxer->mutex);
+
+  // every pass is as long as the first one, and the clock of the file
+  // begins at its start time
+  double start = demuxer_get_start_time(demuxer);
+  if (length <= 0.0 || seconds < start + length) {
+    return seconds;
+  }
+  return start + SDL_fmod(seconds - start, length);
+}
+
+double demuxer_get_duration(Demuxer *demuxer) {
+  if (demuxer->pFormatCtx->duration == AV_NOPTS_VALUE) {
+    return 0.0;
+  }
+  return (double)demuxer->pFormatCtx->duration / AV_TIME_BASE;
+}
+
+double demuxer_get_start_time(Demuxer *demuxer) {
+  if (demuxer->pFormatCtx->start_time == AV_NOPTS_VALUE) {
+    return 0.0;
+  }
+  return (double)demuxer->pFormatCtx->start_time / AV_TIME_BASE;
+}
+
+void demuxer_abort(Demuxer *demuxer) {
+  if (!demuxer) {
+    return;
+  }
+
+  packet_queue_abort(&demuxer->videoQueue);
+  packet_queue_abort(&demuxer->audioQueue);
+}
+
+void demuxer_close(Demuxer *demuxer) {
+  if (!demuxer) {
+    return;
+  }
+
+  demuxer_abort(demuxer);
+
+  demuxer->running = false;
+  if (demuxer->thread) {
+    SDL_LockMutex(demuxer->mutex);
+    SDL_SignalCondition(demuxer->cond);
+    SDL_UnlockMutex(demuxer->mutex);
+
+    SDL_WaitThread(demuxer->thread, NULL);
+    demuxer->thread = NULL;
+  }
+  seek_index_destroy(demuxer->index);
+
+  packet_queue_destroy(&demuxer->videoQueue);
+  packet_queue_destroy(&demuxer->audioQueue);
+
+  if (demuxer->cond) {
+    SDL_DestroyCondition(demuxer->cond);
+  }
+  if (demuxer->mutex) {
+    SDL_DestroyMutex(demuxer->mutex);
+  }
+
+  avformat_close_input(&demuxer->pFormatCtx);
+  free(demuxer);
+}
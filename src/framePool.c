@@ -0,0 +1,154 @@
+#include "framePool.h"
+
+// row and plane alignment of the pooled frames, enough for SIMD in swscale
+#define FRAME_POOL_ALIGN 64
+
+static void frame_pool_unref(FramePool *pool) {
+  if (SDL_AtomicDecRef(&pool->refs)) {
+    av_buffer_pool_uninit(&pool->pool);
+    free(pool);
+  }
+}
+
+// only called by the AVBufferPool when it has no free buffer left
+static AVBufferRef *frame_pool_alloc(void *opaque, size_t size) {
+  FramePool *pool = (FramePool *)opaque;
+
+  uint8_t *data = av_malloc(size);
+  if (!data) {
+    return NULL;
+  }
+
+  // the pool is kept as opaque of the buffer, frame_pool_release needs it
+  AVBufferRef *buf =
+      av_buffer_create(data, size, av_buffer_default_free, pool, 0);
+  if (!buf) {
+    av_free(data);
+    return NULL;
+  }
+
+  SDL_AddAtomicInt(&pool->misses, 1);
+  return buf;
+}
+
+// the frame let go of its buffer, hand it back to the AVBufferPool
+static void frame_pool_release(void *opaque, uint8_t *data) {
+  AVBufferRef *pooled = (AVBufferRef *)opaque;
+  FramePool *pool = (FramePool *)av_buffer_pool_buffer_get_opaque(pooled);
+
+  av_buffer_unref(&pooled);
+  frame_pool_unref(pool);
+}
+
+FramePool *frame_pool_create(enum AVPixelFormat format, int width, int height) {
+  FramePool *pool = (FramePool *)calloc(1, sizeof(FramePool));
+  if (!pool) {
+    printf("FramePool - Memory allocation error.\n");
+    return NULL;
+  }
+
+  pool->format = format;
+  pool->width = width;
+  pool->height = height;
+
+  int size = av_image_get_buffer_size(format, width, height, FRAME_POOL_ALIGN);
+  if (size < 0) {
+    printf("FramePool - unsupported format %d (%dx%d).\n", format, width,
+           height);
+    free(pool);
+    return NULL;
+  }
+  pool->bufferSize = (size_t)size;
+
+  pool->pool =
+      av_buffer_pool_init2(pool->bufferSize, pool, frame_pool_alloc, NULL);
+  if (!pool->pool) {
+    printf("FramePool - could not create buffer pool.\n");
+    free(pool);
+    return NULL;
+  }
+
+  SDL_SetAtomicInt(&pool->refs, 1);
+  SDL_SetAtomicInt(&pool->requests, 0);
+  SDL_SetAtomicInt(&pool->misses, 0);
+
+  return pool;
+}
+
+FramePool *frame_pool_create_for_hw(AVBufferRef *hw_frames_ctx) {
+  AVHWFramesContext *frames = (AVHWFramesContext *)hw_frames_ctx->data;
+  return frame_pool_create(frames->sw_format, frames->width, frames->height);
+}
+
+bool frame_pool_matches(FramePool *pool, AVBufferRef *hw_frames_ctx) {
+  AVHWFramesContext *frames = (AVHWFramesContext *)hw_frames_ctx->data;
+  return frames->sw_format == pool->format && frames->width == pool->width &&
+         frames->height == pool->height;
+}
+
+int frame_pool_get(FramePool *pool, AVFrame *frame) {
+  AVBufferRef *pooled = av_buffer_pool_get(pool->pool);
+  if (!pooled) {
+    return AVERROR(ENOMEM);
+  }
+
+  // wrapped, so the pool knows when the frame is unreferenced
+  AVBufferRef *buf = av_buffer_create(pooled->data, pooled->size,
+                                      frame_pool_release, pooled, 0);
+  if (!buf) {
+    av_buffer_unref(&pooled);
+    return AVERROR(ENOMEM);
+  }
+  SDL_AtomicIncRef(&pool->refs);
+  SDL_AddAtomicInt(&pool->requests, 1);
+
+  frame->format = pool->format;
+  frame->width = pool->width;
+  frame->height = pool->height;
+  frame->buf[0] = buf;
+  av_image_fill_arrays(frame->data, frame->linesize, buf->data, pool->format,
+                       pool->width, pool->height, FRAME_POOL_ALIGN);
+  frame->extended_data = frame->data;
+
+  return 0;
+}
+
+int frame_pool_transfer(FramePool *pool, AVFrame *dst, const AVFrame *src) {
+  if (src->width > pool->width || src->height > pool->height) {
+    return AVERROR(EINVAL);
+  }
+
+  int ret = frame_pool_get(pool, dst);
+  if (ret < 0) {
+    return ret;
+  }
+
+  // the surfaces of a hw frames context can be larger than the picture
+  dst->width = src->width;
+  dst->height = src->height;
+
+  if (src->hw_frames_ctx) {
+    ret = av_hwframe_transfer_data(dst, src, 0);
+  } else {
+    ret = av_frame_copy(dst, src);
+  }
+  if (ret < 0) {
+    av_frame_unref(dst);
+  }
+
+  return ret;
+}
+
+void frame_pool_get_stats(FramePool *pool, FramePoolStats *stats) {
+  stats->requests = SDL_GetAtomicInt(&pool->requests);
+  stats->misses = SDL_GetAtomicInt(&pool->misses);
+  stats->in_use = SDL_GetAtomicInt(&pool->refs) - 1;
+}
+
+void frame_pool_destroy(FramePool *pool) {
+  if (!pool) {
+    return;
+  }
+
+  frame_pool_unref(pool);
+}
@@ -0,0 +1,106 @@
+#include "frameRing.h"
+
+FrameRing *frame_ring_create(VideoContainer *video) {
+  FrameRing *ring = (FrameRing *)calloc(1, sizeof(FrameRing));
+  if (!ring) {
+    SDL_Log("FrameRing - Memory allocation error.");
+    return NULL;
+  }
+
+  // every slot gets its own frames, the planes are written into the PBO slot
+  // the renderer attaches to it.
+  for (int i = 0; i < FRAME_RING_SIZE; i++) {
+    ring->slots[i] = init_video_frames(video);
+    if (!ring->slots[i]) {
+      frame_ring_destroy(ring);
+      return NULL;
+    }
+  }
+
+  SDL_SetAtomicU32(&ring->readIndex, 0);
+  SDL_SetAtomicU32(&ring->writeIndex, 0);
+  ring->peekIndex = 0;
+
+  ring->space = SDL_CreateSemaphore(0);
+  if (!ring->space) {
+    SDL_Log("FrameRing - could not create semaphore: %s", SDL_GetError());
+    frame_ring_destroy(ring);
+    return NULL;
+  }
+
+  return ring;
+}
+
+void frame_ring_destroy(FrameRing *ring) {
+  if (!ring) {
+    return;
+  }
+
+  for (int i = 0; i < FRAME_RING_SIZE; i++) {
+    free_video_frames(ring->slots[i]);
+  }
+  if (ring->space) {
+    SDL_DestroySemaphore(ring->space);
+  }
+  free(ring);
+}
+
+vFrame *frame_ring_peek_writable(FrameRing *ring) {
+  Uint32 write = SDL_GetAtomicU32(&ring->writeIndex);
+  Uint32 read = SDL_GetAtomicU32(&ring->readIndex);
+
+  if (write - read >= FRAME_RING_SIZE) {
+    return NULL;
+  }
+  return ring->slots[write % FRAME_RING_SIZE];
+}
+
+void frame_ring_push(FrameRing *ring) {
+  SDL_SetAtomicU32(&ring->writeIndex, SDL_GetAtomicU32(&ring->writeIndex) + 1);
+}
+
+void frame_ring_wait(FrameRing *ring, Sint32 timeoutMS) {
+  SDL_WaitSemaphoreTimeout(ring->space, timeoutMS);
+}
+
+void frame_ring_wake(FrameRing *ring) { SDL_SignalSemaphore(ring->space); }
+
+vFrame *frame_ring_peek(FrameRing *ring) {
+  Uint32 write = SDL_GetAtomicU32(&ring->writeIndex);
+
+  if (write == ring->peekIndex) {
+    return NULL;
+  }
+  return ring->slots[ring->peekIndex % FRAME_RING_SIZE];
+}
+
+void frame_ring_pop(FrameRing *ring) {
+  ring->peekIndex++;
+  SDL_SetAtomicU32(&ring->readIndex, ring->peekIndex);
+  SDL_SignalSemaphore(ring->space);
+}
+
+void frame_ring_advance(FrameRing *ring) { ring->peekIndex++; }
+
+vFrame *frame_ring_peek_held(FrameRing *ring) {
+  Uint32 read = SDL_GetAtomicU32(&ring->readIndex);
+
+  if (read == ring->peekIndex) {
+    return NULL;
+  }
+  return ring->slots[read % FRAME_RING_SIZE];
+}
+
+void frame_ring_release(FrameRing *ring) {
+  SDL_SetAtomicU32(&ring->readIndex, SDL_GetAtomicU32(&ring->readIndex) + 1);
+  SDL_SignalSemaphore(ring->space);
+}
+
+int frame_ring_pending(FrameRing *ring) {
+  return (int)(SDL_GetAtomicU32(&ring->writeIndex) - ring->peekIndex);
+}
+
+int frame_ring_count(FrameRing *ring) {
+  return (int)(SDL_GetAtomicU32(&ring->writeIndex) -
+               SDL_GetAtomicU32(&ring->readIndex));
+}
@@ -0,0 +1,62 @@
+#include "glExtensions.h"
+
+PFNGLBUFFERSTORAGEPROC ext_glBufferStorage = NULL;
+PFNGLGETPROGRAMBINARYPROC ext_glGetProgramBinary = NULL;
+PFNGLPROGRAMBINARYPROC ext_glProgramBinary = NULL;
+PFNGLPROGRAMPARAMETERIPROC ext_glProgramParameteri = NULL;
+
+GLExtensions GLExt = {0};
+
+static bool hasVersion(int major, int minor) {
+  GLint contextMajor = 0, contextMinor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+  glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+
+  return contextMajor > major ||
+         (contextMajor == major && contextMinor >= minor);
+}
+
+static bool hasExtension(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+  for (GLint i = 0; i < count; i++) {
+    const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (extension && strcmp(extension, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void loadGLExtensions(void) {
+
+  if (hasVersion(4, 4) || hasExtension("GL_ARB_buffer_storage")) {
+    ext_glBufferStorage =
+        (PFNGLBUFFERSTORAGEPROC)SDL_GL_GetProcAddress("glBufferStorage");
+  }
+  GLExt.bufferStorage = ext_glBufferStorage != NULL;
+
+  if (hasVersion(4, 1) || hasExtension("GL_ARB_get_program_binary")) {
+    ext_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)SDL_GL_GetProcAddress(
+        "glGetProgramBinary");
+    ext_glProgramBinary =
+        (PFNGLPROGRAMBINARYPROC)SDL_GL_GetProcAddress("glProgramBinary");
+    ext_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)SDL_GL_GetProcAddress(
+        "glProgramParameteri");
+  }
+  // some drivers have the functions but no format to save programs in
+  GLint binaryFormats = 0;
+  if (ext_glGetProgramBinary && ext_glProgramBinary &&
+      ext_glProgramParameteri) {
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+  }
+  GLExt.programBinary = binaryFormats > 0;
+
+  SDL_Log("OpenGL %s (%s), persistent mapped buffers: %s, program binaries: "
+          "%s",
+          (const char *)glGetString(GL_VERSION),
+          (const char *)glGetString(GL_RENDERER),
+          GLExt.bufferStorage ? "yes" : "no",
+          GLExt.programBinary ? "yes" : "no");
+}
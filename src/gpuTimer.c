@@ -0,0 +1,126 @@
+#include "gpuTimer.h"
+
+static const char *stageNames[GPU_STAGE_COUNT] = {"upload", "draw"};
+
+static void addSample(GpuTimeHistogram *histogram, GLuint64 ns) {
+  // the oldest sample leaves the window and its bucket
+  if (histogram->windowCount == GPU_TIMER_WINDOW) {
+    GLuint64 oldest = histogram->window[histogram->windowIndex];
+    GLuint64 oldBucket = oldest / GPU_TIMER_BUCKET_NS;
+    histogram->buckets[SDL_min(oldBucket, GPU_TIMER_BUCKETS - 1)]--;
+  } else {
+    histogram->windowCount++;
+  }
+
+  histogram->window[histogram->windowIndex] = ns;
+  histogram->windowIndex = (histogram->windowIndex + 1) % GPU_TIMER_WINDOW;
+
+  GLuint64 bucket = ns / GPU_TIMER_BUCKET_NS;
+  histogram->buckets[SDL_min(bucket, GPU_TIMER_BUCKETS - 1)]++;
+
+  if (ns > histogram->maxNs) {
+    histogram->maxNs = ns;
+  }
+}
+
+// upper edge of the bucket the percentile falls into, in milliseconds
+static double percentileMs(const GpuTimeHistogram *histogram, int percent) {
+  if (histogram->windowCount == 0) {
+    return 0.0;
+  }
+
+  int rank = (histogram->windowCount * percent + 99) / 100;
+  int seen = 0;
+  for (int i = 0; i < GPU_TIMER_BUCKETS - 1; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      return (double)(i + 1) * GPU_TIMER_BUCKET_NS / 1e6;
+    }
+  }
+  // inside the overflow bucket, the maximum is the only upper bound known
+  return histogram->maxNs / 1e6;
+}
+
+// reads the result of a query, but only if the GPU already has it
+static void collectQuery(GpuTimer *timer, int slot, GpuTimerStage stage) {
+  GLuint query = timer->queries[slot][stage];
+
+  GLint available = 0;
+  glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) {
+    return;
+  }
+
+  GLuint64 ns = 0;
+  glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+  addSample(&timer->histograms[stage], ns);
+  timer->pending[slot][stage] = false;
+}
+
+void initGpuTimer(GpuTimer *timer) {
+  SDL_memset(timer, 0, sizeof(GpuTimer));
+  glGenQueries(GPU_TIMER_RING_SIZE * GPU_STAGE_COUNT, &timer->queries[0][0]);
+}
+
+void beginGpuTimer(GpuTimer *timer, GpuTimerStage stage) {
+  int slot = timer->frameIndex;
+
+  // the GPU is more than GPU_TIMER_RING_SIZE frames behind, this frame is
+  // not measured rather than waiting for it
+  if (timer->pending[slot][stage]) {
+    collectQuery(timer, slot, stage);
+    if (timer->pending[slot][stage]) {
+      timer->skipped[stage]++;
+      return;
+    }
+  }
+
+  glBeginQuery(GL_TIME_ELAPSED, timer->queries[slot][stage]);
+  timer->running[stage] = true;
+}
+
+void endGpuTimer(GpuTimer *timer, GpuTimerStage stage) {
+  if (!timer->running[stage]) {
+    return;
+  }
+
+  glEndQuery(GL_TIME_ELAPSED);
+  timer->running[stage] = false;
+  timer->pending[timer->frameIndex][stage] = true;
+}
+
+void advanceGpuTimer(GpuTimer *timer) {
+  for (int slot = 0; slot < GPU_TIMER_RING_SIZE; slot++) {
+    for (int stage = 0; stage < GPU_STAGE_COUNT; stage++) {
+      if (timer->pending[slot][stage]) {
+        collectQuery(timer, slot, (GpuTimerStage)stage);
+      }
+    }
+  }
+  timer->frameIndex = (timer->frameIndex + 1) % GPU_TIMER_RING_SIZE;
+}
+
+void getGpuTimerStats(GpuTimer *timer, GpuTimerStage stage,
+                      GpuTimerStats *stats) {
+  const GpuTimeHistogram *histogram = &timer->histograms[stage];
+
+  stats->count = histogram->windowCount;
+  stats->p50Ms = percentileMs(histogram, 50);
+  stats->p95Ms = percentileMs(histogram, 95);
+  stats->p99Ms = percentileMs(histogram, 99);
+  stats->maxMs = histogram->maxNs / 1e6;
+  stats->skipped = timer->skipped[stage];
+}
+
+const char *gpuTimerStageName(GpuTimerStage stage) {
+  return stage < GPU_STAGE_COUNT ? stageNames[stage] : "unknown";
+}
+
+void cleanupGpuTimer(GpuTimer *timer) {
+  // a query that is still running has to be ended before it is deleted
+  for (int stage = 0; stage < GPU_STAGE_COUNT; stage++) {
+    endGpuTimer(timer, (GpuTimerStage)stage);
+  }
+  glDeleteQueries(GPU_TIMER_RING_SIZE * GPU_STAGE_COUNT,
+                  &timer->queries[0][0]);
+}
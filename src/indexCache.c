@@ -0,0 +1,255 @@
+#include "indexCache.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char INDEX_CACHE_MAGIC[4] = {'L', 'S', 'I', 'X'};
+
+// absolute path of the video, the same file opened through another relative
+// path still finds its sidecar
+static bool absolute_path(const char *path, char *resolved) {
+  if (realpath(path, resolved)) {
+    return true;
+  }
+  if (strlen(path) >= PATH_MAX) {
+    return false;
+  }
+  strcpy(resolved, path);
+  return true;
+}
+
+// $XDG_CACHE_HOME/LunaScape/<hash of the path>.idx
+static bool sidecar_path(const char *absolute, char *sidecar, size_t size) {
+  char dir[PATH_MAX];
+  if (!cache_directory(NULL, dir, sizeof(dir))) {
+    return false;
+  }
+
+  uint64_t hash = cache_hash(CACHE_HASH_INIT, absolute, strlen(absolute));
+  int written = snprintf(sidecar, size, "%s/%016llx.idx", dir,
+                         (unsigned long long)hash);
+  return written > 0 && written < (int)size;
+}
+
+IndexCache *index_cache_open(const char *path) {
+  char absolute[PATH_MAX];
+  char sidecar[PATH_MAX];
+  SDL_PathInfo info;
+  if (!absolute_path(path, absolute) ||
+      !sidecar_path(absolute, sidecar, sizeof(sidecar)) ||
+      !SDL_GetPathInfo(absolute, &info)) {
+    return NULL;
+  }
+
+  int fd = open(sidecar, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexCacheHeader)) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = (size_t)st.st_size;
+  void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+
+  // same format, same file, same version of the file
+  const IndexCacheHeader *header = (const IndexCacheHeader *)base;
+  size_t pathBytes = ((size_t)header->pathLength + 7) & ~(size_t)7;
+  bool valid =
+      memcmp(header->magic, INDEX_CACHE_MAGIC, sizeof(INDEX_CACHE_MAGIC)) ==
+          0 &&
+      header->version == INDEX_CACHE_VERSION && header->entrySize > 0 &&
+      header->count >= 0 && header->fileSize == (int64_t)info.size &&
+      header->mtimeNs == (int64_t)info.modify_time &&
+      header->pathLength == strlen(absolute) &&
+      sizeof(IndexCacheHeader) + pathBytes <= size &&
+      memcmp((const char *)base + sizeof(IndexCacheHeader), absolute,
+             header->pathLength) == 0 &&
+      (size - sizeof(IndexCacheHeader) - pathBytes) / header->entrySize >=
+          (uint64_t)header->count;
+  if (!valid) {
+    munmap(base, size);
+    return NULL;
+  }
+
+  IndexCache *cache = (IndexCache *)calloc(1, sizeof(IndexCache));
+  if (!cache) {
+    munmap(base, size);
+    return NULL;
+  }
+  cache->base = base;
+  cache->size = size;
+  cache->header = header;
+  cache->entries = (const char *)base + sizeof(IndexCacheHeader) + pathBytes;
+
+  // the index is never read in order, only binary searched
+  madvise(base, size, MADV_RANDOM);
+  return cache;
+}
+
+void index_cache_close(IndexCache *cache) {
+  if (!cache) {
+    return;
+  }
+  munmap(cache->base, cache->size);
+  free(cache);
+}
+
+// a stream index read from the file is only used if it exists and the stream
+// behind it is still the same. -1 means the file has no such stream.
+static bool stream_matches(AVFormatContext *pFormatCtx, int index,
+                           enum AVMediaType type, int codecId) {
+  if (index < 0) {
+    return index == -1;
+  }
+  if (index >= (int)pFormatCtx->nb_streams) {
+    return false;
+  }
+  AVCodecParameters *par = pFormatCtx->streams[index]->codecpar;
+  return par->codec_type == type && par->codec_id == (enum AVCodecID)codecId;
+}
+
+bool index_cache_apply(const IndexCache *cache, AVFormatContext *pFormatCtx) {
+  const IndexCacheStreams *streams = &cache->header->streams;
+  if ((int)pFormatCtx->nb_streams != streams->nbStreams ||
+      !stream_matches(pFormatCtx, streams->videoStreamIndex,
+                      AVMEDIA_TYPE_VIDEO, streams->videoCodecId) ||
+      !stream_matches(pFormatCtx, streams->audioStreamIndex,
+                      AVMEDIA_TYPE_AUDIO, streams->audioCodecId)) {
+    return false;
+  }
+
+  // both streams fit, nothing is changed before that is known
+  if (streams->videoStreamIndex >= 0) {
+    AVStream *stream = pFormatCtx->streams[streams->videoStreamIndex];
+    AVCodecParameters *par = stream->codecpar;
+    if (par->width <= 0 || par->height <= 0) {
+      par->width = streams->width;
+      par->height = streams->height;
+    }
+    if (par->format < 0) {
+      par->format = streams->pixelFormat;
+    }
+    if (stream->avg_frame_rate.num <= 0 && streams->frameRateNum > 0) {
+      stream->avg_frame_rate =
+          (AVRational){streams->frameRateNum, streams->frameRateDen};
+    }
+    if (stream->r_frame_rate.num <= 0) {
+      stream->r_frame_rate = stream->avg_frame_rate;
+    }
+    if (stream->start_time == AV_NOPTS_VALUE) {
+      stream->start_time = streams->videoStartTime;
+    }
+  }
+
+  if (streams->audioStreamIndex >= 0) {
+    AVStream *stream = pFormatCtx->streams[streams->audioStreamIndex];
+    AVCodecParameters *par = stream->codecpar;
+    if (par->sample_rate <= 0) {
+      par->sample_rate = streams->sampleRate;
+    }
+    if (par->ch_layout.nb_channels <= 0) {
+      av_channel_layout_default(&par->ch_layout, streams->channels);
+    }
+    if (stream->start_time == AV_NOPTS_VALUE) {
+      stream->start_time = streams->audioStartTime;
+    }
+  }
+
+  if (pFormatCtx->duration == AV_NOPTS_VALUE) {
+    pFormatCtx->duration = streams->duration;
+  }
+  if (pFormatCtx->start_time == AV_NOPTS_VALUE) {
+    pFormatCtx->start_time = streams->startTime;
+  }
+  return true;
+}
+
+void index_cache_describe(AVFormatContext *pFormatCtx, int videoStreamIndex,
+                          int audioStreamIndex, IndexCacheStreams *streams) {
+  memset(streams, 0, sizeof(*streams));
+  streams->nbStreams = (int32_t)pFormatCtx->nb_streams;
+  streams->videoStreamIndex = videoStreamIndex;
+  streams->audioStreamIndex = audioStreamIndex;
+  streams->duration = pFormatCtx->duration;
+  streams->startTime = pFormatCtx->start_time;
+  streams->videoStartTime = AV_NOPTS_VALUE;
+  streams->audioStartTime = AV_NOPTS_VALUE;
+
+  if (videoStreamIndex >= 0) {
+    AVStream *stream = pFormatCtx->streams[videoStreamIndex];
+    AVRational frame_rate = av_guess_frame_rate(pFormatCtx, stream, NULL);
+    streams->videoCodecId = stream->codecpar->codec_id;
+    streams->width = stream->codecpar->width;
+    streams->height = stream->codecpar->height;
+    streams->pixelFormat = stream->codecpar->format;
+    streams->frameRateNum = frame_rate.num;
+    streams->frameRateDen = frame_rate.den;
+    streams->videoStartTime = stream->start_time;
+  }
+  if (audioStreamIndex >= 0) {
+    AVCodecParameters *par = pFormatCtx->streams[audioStreamIndex]->codecpar;
+    streams->audioCodecId = par->codec_id;
+    streams->sampleRate = par->sample_rate;
+    streams->channels = par->ch_layout.nb_channels;
+    streams->audioStartTime = pFormatCtx->streams[audioStreamIndex]->start_time;
+  }
+}
+
+bool index_cache_save(const char *path, const IndexCacheStreams *streams,
+                      const void *entries, int64_t count, size_t entrySize) {
+  char absolute[PATH_MAX];
+  char sidecar[PATH_MAX];
+  char temporary[PATH_MAX + 8];
+  SDL_PathInfo info;
+  if (!absolute_path(path, absolute) ||
+      !sidecar_path(absolute, sidecar, sizeof(sidecar)) ||
+      !SDL_GetPathInfo(absolute, &info)) {
+    return false;
+  }
+
+  IndexCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, INDEX_CACHE_MAGIC, sizeof(INDEX_CACHE_MAGIC));
+  header.version = INDEX_CACHE_VERSION;
+  header.entrySize = (uint32_t)entrySize;
+  header.pathLength = (uint32_t)strlen(absolute);
+  header.fileSize = (int64_t)info.size;
+  header.mtimeNs = (int64_t)info.modify_time;
+  header.count = count;
+  header.streams = *streams;
+
+  // the path is padded, so the entries stay 8 byte aligned in the mapping
+  static const char padding[8] = {0};
+  size_t pathBytes = ((size_t)header.pathLength + 7) & ~(size_t)7;
+
+  // written next to the old file and renamed, a player reading it at the
+  // same time never sees half of it
+  snprintf(temporary, sizeof(temporary), "%s.tmp", sidecar);
+  FILE *file = fopen(temporary, "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(absolute, 1, header.pathLength, file) == header.pathLength &&
+            fwrite(padding, 1, pathBytes - header.pathLength, file) ==
+                pathBytes - header.pathLength &&
+            fwrite(entries, entrySize, (size_t)count, file) == (size_t)count;
+  ok = fclose(file) == 0 && ok;
+
+  if (!ok || rename(temporary, sidecar) != 0) {
+    remove(temporary);
+    fprintf(stderr, "IndexCache - could not write %s.\n", sidecar);
+    return false;
+  }
+  return true;
+}
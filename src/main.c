@@ -4,32 +4,245 @@
 const unsigned int SCR_WIDTH = 1920;
 const unsigned int SCR_HEIGHT = 1080;
 
+// longest wait for a frame inside one loop iteration, so events are still
+// handled when the next frame is far away
+#define FRAME_MAX_WAIT 0.1 // seconds
+
+// arrow keys: left/right jump by SEEK_SHORT, up/down by SEEK_LONG
+#define SEEK_SHORT 5.0  // seconds
+#define SEEK_LONG 60.0 // seconds
+
+// seeks to seconds, clamped to the file. Frames of serials up to dropSerial
+// are still from the old position and never shown.
+static void seek_playback(Demuxer *demuxer, VideoDecoder *videoDecoder,
+                          double seconds, SeekMode mode, int *dropSerial) {
+  double start = demuxer_get_start_time(demuxer);
+  double duration = demuxer_get_duration(demuxer);
+  if (duration > 0.0) {
+    seconds = SDL_min(seconds, start + duration);
+  }
+  seconds = SDL_max(seconds, start);
+
+  *dropSerial = packet_queue_serial(&demuxer->videoQueue);
+  demuxer_seek(demuxer, seconds, mode);
+  video_decoder_wake(videoDecoder);
+  SDL_Log("Seeking to %.1f s.", seconds);
+}
+
+// command line options that take the next argument as their value
+static bool option_needs_value(const char *arg) {
+  static const char *const options[] = {"--upload", "--pbo-depth",
+                                        "--bench",  "--bench-frames",
+                                        "--trace",  "--seek"};
+  for (size_t i = 0; i < SDL_arraysize(options); i++) {
+    if (strcmp(arg, options[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// time of one step of the startup, the steps on worker threads overlap with
+// the ones of the main thread
+static void log_startup_step(const char *step, Uint64 start) {
+  SDL_Log("Startup: %-22s %7.1f ms", step,
+          (double)(SDL_GetTicksNS() - start) / 1e6);
+}
+
+// the renderer follows the format of the new video, then the new decoder
+// starts writing into its PBO slots
+static bool start_switched_video(Renderer *renderer,
+                                 const RendererConfig *rendererConfig,
+                                 VideoContainer *video,
+                                 VideoDecoder *videoDecoder, int oldWidth,
+                                 int oldHeight, enum AVPixelFormat oldFormat) {
+  // if the dimensions or the pixel format of the old video are not the same
+  // as the ones of the new video, the texures in the renderer need to be
+  // updated too
+  if (video->pCodecCtx->width != oldWidth ||
+      video->pCodecCtx->height != oldHeight || video->upload_fmt != oldFormat) {
+    SDL_Log("Video format changed: old: %dx%d, new: %dx%d. "
+            "Reinitializing renderer...",
+            oldWidth, oldHeight, video->pCodecCtx->width,
+            video->pCodecCtx->height);
+    cleanupRenderer(renderer);
+    initRenderer(renderer, video->pCodecCtx->width, video->pCodecCtx->height,
+                 video->upload_fmt, rendererConfig);
+  }
+
+  attachFrameRing(renderer, videoDecoder->ring);
+  if (!video_decoder_start(videoDecoder)) {
+    SDL_Log("Failed to start the new video decoder");
+    return false;
+  }
+  return true;
+}
+
+// startup: the first file is prepared on a worker thread
+typedef struct StartupJob {
+  Playlist *playlist;
+  PreparedMedia *media;
+} StartupJob;
+
+static int startup_prepare_func(void *data) {
+  StartupJob *job = (StartupJob *)data;
+  job->media = playlist_open_current(job->playlist);
+  if (!job->media) {
+    job->media = playlist_next(job->playlist, 1);
+  }
+  return 0;
+}
+
+// startup: the audio device is opened next to the renderer setup
+typedef struct AudioStartupJob {
+  AudioManager *audioManager;
+  AudioContainer *audio;
+  int result;
+} AudioStartupJob;
+
+static int startup_audio_func(void *data) {
+  AudioStartupJob *job = (AudioStartupJob *)data;
+  Uint64 start = SDL_GetTicksNS();
+  job->result = audio_manager_init_container(job->audioManager, job->audio);
+  log_startup_step("audio device", start);
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
 
-  char *video_file = KDE_Plasma_select_video_file();
-  if (!video_file || video_file[0] == '\0') {
-    SDL_Log("No videofile selected. Closing programm.");
-    if (video_file) {
-      free(video_file);
+  // how frames are uploaded, "--upload tex|pbo|persistent" and
+  // "--pbo-depth <n>" for the ring of persistent mapped PBOs.
+  // "--no-tonemap" shows HDR video without mapping it to SDR.
+  RendererConfig rendererConfig = {UPLOAD_PERSISTENT_PBO,
+                                   PBO_RING_DEFAULT_DEPTH, true};
+
+  // "--bench <file>" runs the pipeline headless and as fast as possible,
+  // "--bench-frames <n>" stops early, "--json" for the report
+  BenchmarkOptions benchOptions = {NULL, {0}, 0, false};
+
+  // "--trace <file>" records what every thread does, written on exit or
+  // when "T" is pressed
+  const char *tracePath = NULL;
+
+  // "--seek fast" jumps to keyframes, "--seek accurate" (default) decodes up
+  // to the exact position
+  SeekMode seekMode = SEEK_ACCURATE;
+
+  // "--headless" plays without a display and a sound device, for scripted
+  // runs. The files come from the command line then.
+  bool headless = false;
+
+  // initialized after the window, its clock is already handed to the video
+  // decoders for dropping late frames
+  AudioManager audioManager;
+
+  // every other argument is a video or a directory of videos, more than one
+  // video is a playlist
+  Playlist playlist;
+  playlist_init(&playlist, &audioManager.clock);
+
+  for (int i = 1; i < argc; i++) {
+    if (option_needs_value(argv[i]) && i + 1 >= argc) {
+      SDL_Log("%s needs a value.", argv[i]);
+      playlist_destroy(&playlist);
+      return -1;
+    }
+    if (strcmp(argv[i], "--upload") == 0) {
+      if (!parseUploadMode(argv[++i], &rendererConfig.uploadMode)) {
+        SDL_Log("Unknown upload mode %s, use tex, pbo or persistent.", argv[i]);
+        playlist_destroy(&playlist);
+        return -1;
+      }
+    } else if (strcmp(argv[i], "--pbo-depth") == 0) {
+      rendererConfig.pboDepth = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--no-tonemap") == 0) {
+      rendererConfig.toneMapping = false;
+    } else if (strcmp(argv[i], "--bench") == 0) {
+      benchOptions.path = argv[++i];
+    } else if (strcmp(argv[i], "--bench-frames") == 0) {
+      benchOptions.maxFrames = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--json") == 0) {
+      benchOptions.json = true;
+    } else if (strcmp(argv[i], "--trace") == 0) {
+      tracePath = argv[++i];
+    } else if (strcmp(argv[i], "--seek") == 0) {
+      i++;
+      if (strcmp(argv[i], "fast") == 0) {
+        seekMode = SEEK_FAST;
+      } else if (strcmp(argv[i], "accurate") == 0) {
+        seekMode = SEEK_ACCURATE;
+      } else {
+        SDL_Log("Unknown seek mode %s, use fast or accurate.", argv[i]);
+        playlist_destroy(&playlist);
+        return -1;
+      }
+    } else if (strcmp(argv[i], "--headless") == 0) {
+      headless = true;
+    } else if (argv[i][0] == '-') {
+      SDL_Log("Unknown option %s.", argv[i]);
+      playlist_destroy(&playlist);
+      return -1;
+    } else if (!playlist_add(&playlist, argv[i])) {
+      // a scripted start must not end up in the file dialog
+      playlist_destroy(&playlist);
+      return -1;
     }
-    return -1;
   }
 
-  VideoContainer *video = init_video_container(video_file, false);
-  if (!video) {
-    SDL_Log("Failed to init video\n");
-    free(video_file);
-    return -1;
+  if (tracePath) {
+    trace_init();
+    trace_register_thread("RenderThread");
   }
 
-  vFrame *videoFrame = init_video_frames(video);
-  if (!videoFrame) {
-    SDL_Log("Failed to init videoFrames");
+  if (benchOptions.path) {
+    benchOptions.rendererConfig = rendererConfig;
+    int result = run_benchmark(&benchOptions);
+    if (tracePath) {
+      trace_dump(tracePath);
+      trace_shutdown();
+    }
+    return result;
+  }
 
-    return -1;
+  if (headless) {
+    // has to be set before SDL_Init, like for the benchmark
+    SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+    SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+    if (playlist.count == 0) {
+      SDL_Log("--headless needs the videos on the command line.");
+      return -1;
+    }
+  }
+
+  // without files on the command line the file dialog asks for one
+  if (playlist.count == 0) {
+    char *video_file = KDE_Plasma_select_video_file();
+    if (!video_file || video_file[0] == '\0') {
+      SDL_Log("No videofile selected. Closing programm.");
+      if (video_file) {
+        free(video_file);
+      }
+      return -1;
+    }
+    playlist_add(&playlist, video_file);
+    free(video_file);
+  }
+
+  // The file is opened, probed and its first frame decoded on a worker
+  // thread, while this thread brings up the window, the GL context and the
+  // shaders. The demuxer reads the file once for both, video and audio
+  // decoding, the video decoder decodes into a ring of pre-allocated frames
+  // on its own thread.
+  Uint64 startupStart = SDL_GetTicksNS();
+  StartupJob startupJob = {&playlist, NULL};
+  SDL_Thread *startupThread =
+      SDL_CreateThread(startup_prepare_func, "StartupThread", &startupJob);
+  if (!startupThread) {
+    startup_prepare_func(&startupJob);
   }
 
   // init SDL3 window with OpenGL context.
+  Uint64 stepStart = SDL_GetTicksNS();
   SDL_Window *window =
       initWayWindowGL("LunaScape", "0.1", SCR_WIDTH, SCR_HEIGHT, true);
 
@@ -46,17 +259,51 @@ int main(int argc, char *argv[]) {
 
     return -1;
   }
+  log_startup_step("window + GL context", stepStart);
 
-  AudioManager audioManager;
-  if (audio_manager_init(&audioManager, video_file) < 0) {
-    SDL_Log("Failed to initialize audio manager");
-    free(video_file);
+  // the shaders don't depend on the video
+  stepStart = SDL_GetTicksNS();
+  preloadRendererShader();
+  log_startup_step("shaders", stepStart);
+
+  stepStart = SDL_GetTicksNS();
+  SDL_WaitThread(startupThread, NULL);
+  log_startup_step("waiting for the file", stepStart);
+
+  if (!startupJob.media) {
+    SDL_Log("Failed to open file\n");
+    playlist_destroy(&playlist);
     return -1;
   }
-  free(video_file);
+  Demuxer *demuxer;
+  VideoContainer *video;
+  VideoDecoder *videoDecoder;
+  AudioContainer *audio;
+  media_prepared_take(startupJob.media, &demuxer, &video, &videoDecoder,
+                      &audio);
+
+  // opening the audio device doesn't need the GL context, it runs next to
+  // the renderer setup
+  AudioStartupJob audioJob = {&audioManager, audio, -1};
+  SDL_Thread *audioThread =
+      SDL_CreateThread(startup_audio_func, "AudioStartupThread", &audioJob);
+  if (!audioThread) {
+    startup_audio_func(&audioJob);
+  }
 
+  stepStart = SDL_GetTicksNS();
   Renderer renderer;
-  initRenderer(&renderer, video->pCodecCtx->width, video->pCodecCtx->height);
+  initRenderer(&renderer, video->pCodecCtx->width, video->pCodecCtx->height,
+               video->upload_fmt, &rendererConfig);
+  log_startup_step("renderer", stepStart);
+
+  stepStart = SDL_GetTicksNS();
+  SDL_WaitThread(audioThread, NULL);
+  log_startup_step("waiting for audio", stepStart);
+  if (audioJob.result < 0) {
+    SDL_Log("Failed to initialize audio manager");
+    return -1;
+  }
 
   bool running = true;
 
@@ -65,6 +312,31 @@ int main(int argc, char *argv[]) {
   // press "F" for activating Fullscreen
   bool isFullscreen = false;
 
+  // the decode thread converts straight into the PBO slots of the renderer
+  attachFrameRing(&renderer, videoDecoder->ring);
+
+  if (!video_decoder_start(videoDecoder)) {
+    SDL_Log("Failed to start video decoder");
+    return -1;
+  }
+
+  // the next file of the playlist gets ready in the background
+  playlist_prefetch(&playlist);
+
+  // serial of the last presented frame, when it changes the video was
+  // seeked and the timing starts over. Loops keep the serial.
+  int frameSerial = -1;
+
+  // frames up to this serial were decoded before the last seek
+  int dropSerial = -1;
+
+  // playlist files to move by before the next frame, the end of a file
+  // moves by one
+  int switchStep = 0;
+
+  // a file picked with "R", switched to before the next frame
+  PreparedMedia *pickedMedia = NULL;
+
   audio_manager_start(&audioManager);
   uint64_t start_time = SDL_GetTicksNS();
   // main render loop
@@ -76,6 +348,14 @@ int main(int argc, char *argv[]) {
         running = false;
       }
 
+      // a file from the dialog, ready to play
+      if (event.type == media_picker_event_type()) {
+        if (event.user.data1) {
+          media_prepared_free(pickedMedia);
+          pickedMedia = (PreparedMedia *)event.user.data1;
+        }
+      }
+
       // Key Press down
       if (event.type == SDL_EVENT_KEY_DOWN) {
 
@@ -104,55 +384,119 @@ int main(int argc, char *argv[]) {
             pauseStart = SDL_GetTicksNS();
             video->paused = true;
             SDL_PauseAudioStreamDevice(audioManager.audioStream);
+            playback_clock_set_paused(&audioManager.clock, true);
 
           } else {
             uint64_t pauseDuration = SDL_GetTicksNS() - pauseStart;
             start_time += pauseDuration;
             video->paused = false;
+            video_decoder_wake(videoDecoder);
             SDL_ResumeAudioStreamDevice(audioManager.audioStream);
+            playback_clock_set_paused(&audioManager.clock, false);
           }
         }
 
-        if (event.key.key == SDLK_R) {
-          // if not paused, before reloading pause video so the it's not
-          // decoding in the background
-          if (!video->paused) {
-            pauseStart = SDL_GetTicksNS();
-            video->paused = true;
-            SDL_PauseAudioStreamDevice(audioManager.audioStream);
-            SDL_Delay(10);
-          }
+        // the dialog runs next to the playback, the picked file arrives as
+        // an event once it is prepared
+        if (event.key.key == SDLK_R && !headless) {
+          media_picker_open_async(&audioManager.clock);
+        }
 
-          // saving old dimensions, for a possible new renderer.
-          int oldWidth = video->pCodecCtx->width;
-          int oldHeight = video->pCodecCtx->height;
+        // "N" and "P" switch to the next / previous file of the playlist
+        if ((event.key.key == SDLK_N || event.key.key == SDLK_P) &&
+            playlist_is_active(&playlist)) {
+          switchStep = event.key.key == SDLK_N ? 1 : -1;
+        }
 
-          if (!reload_video_and_audio(&video, &videoFrame, &audioManager,
-                                      &start_time)) {
-            // if the video selection was cancelled, unpause video
-            uint64_t pauseDuration = SDL_GetTicksNS() - pauseStart;
-            start_time += pauseDuration;
-            video->paused = false;
-            SDL_ResumeAudioStreamDevice(audioManager.audioStream);
-          }
+        if (event.key.key == SDLK_M) {
+          audio_manager_set_muted(&audioManager, !audioManager.muted);
+        }
 
-          // if the dimensions of the old video are not the same as the
-          // dimensions of the new video, the texures in the renderer need to be
-          // updated to these dimensions too
-          if (video && (video->pCodecCtx->width != oldWidth ||
-                        video->pCodecCtx->height != oldHeight)) {
-            SDL_Log("Video resolution changed: old: %dx%d, new: %dx%d. "
-                    "Reinitializing renderer...",
-                    oldWidth, oldHeight, video->pCodecCtx->width,
-                    video->pCodecCtx->height);
-            cleanupRenderer(&renderer);
-            initRenderer(&renderer, video->pCodecCtx->width,
-                         video->pCodecCtx->height);
-          }
+        if (event.key.key == SDLK_EQUALS || event.key.key == SDLK_PLUS ||
+            event.key.key == SDLK_KP_PLUS) {
+          audio_manager_change_volume(&audioManager, AUDIO_VOLUME_STEP);
+        }
+        if (event.key.key == SDLK_MINUS || event.key.key == SDLK_KP_MINUS) {
+          audio_manager_change_volume(&audioManager, -AUDIO_VOLUME_STEP);
         }
 
-        if (event.key.key == SDLK_M) {
-          audioManager.muted = !audioManager.muted;
+        // relative seeks start at what is heard (or seen) right now
+        double position;
+        if (!playback_clock_get(&audioManager.clock, frameSerial, &position)) {
+          uint64_t now = video->paused ? pauseStart : SDL_GetTicksNS();
+          position = (double)(now - start_time) / 1e9;
+        }
+
+        double seekBy = 0.0;
+        switch (event.key.key) {
+        case SDLK_LEFT:
+          seekBy = -SEEK_SHORT;
+          break;
+        case SDLK_RIGHT:
+          seekBy = SEEK_SHORT;
+          break;
+        case SDLK_DOWN:
+          seekBy = -SEEK_LONG;
+          break;
+        case SDLK_UP:
+          seekBy = SEEK_LONG;
+          break;
+        default:
+          break;
+        }
+        if (seekBy != 0.0) {
+          seek_playback(demuxer, videoDecoder,
+                        demuxer_file_position(demuxer, position) + seekBy,
+                        seekMode, &dropSerial);
+        }
+
+        // "0" to "9" jump to 0 % to 90 % of the file, which doesn't have
+        // to start at 0
+        if (event.key.key >= SDLK_0 && event.key.key <= SDLK_9) {
+          double fraction = (event.key.key - SDLK_0) / 10.0;
+          seek_playback(demuxer, videoDecoder,
+                        demuxer_get_start_time(demuxer) +
+                            fraction * demuxer_get_duration(demuxer),
+                        seekMode, &dropSerial);
+        }
+
+        // the last few seconds of every thread, while still playing
+        if (event.key.key == SDLK_T && tracePath) {
+          trace_dump(tracePath);
+        }
+      }
+    }
+
+    // the file of a playlist ended, the decoder has nothing more and every
+    // frame was shown
+    if (playlist_is_active(&playlist) && !video->paused &&
+        video_decoder_is_finished(videoDecoder) &&
+        frame_ring_pending(videoDecoder->ring) == 0) {
+      switchStep = 1;
+    }
+
+    // the next file was prepared in the background, only the threads are
+    // switched here
+    if (switchStep != 0 || pickedMedia) {
+      PreparedMedia *next =
+          pickedMedia ? pickedMedia : playlist_next(&playlist, switchStep);
+      pickedMedia = NULL;
+      switchStep = 0;
+      if (next) {
+        int oldWidth = video->pCodecCtx->width;
+        int oldHeight = video->pCodecCtx->height;
+        enum AVPixelFormat oldFormat = video->upload_fmt;
+
+        running = switch_media(next, &demuxer, &video, &videoDecoder,
+                               &audioManager) &&
+                  start_switched_video(&renderer, &rendererConfig, video,
+                                       videoDecoder, oldWidth, oldHeight,
+                                       oldFormat);
+        frameSerial = -1;
+        dropSerial = -1;
+        playlist_prefetch(&playlist);
+        if (!running) {
+          break;
         }
       }
     }
@@ -163,48 +507,91 @@ int main(int argc, char *argv[]) {
     updateVideoTranformation(&renderer, windowWidth, windowHeight,
                              video->pCodecCtx->width, video->pCodecCtx->height);
 
+    // frames the decode thread converted into a PBO slot are given back once
+    // the GPU finished reading them
+    vFrame *heldFrame;
+    while ((heldFrame = frame_ring_peek_held(videoDecoder->ring)) &&
+           !isFrameInUse(&renderer, heldFrame)) {
+      frame_ring_release(videoDecoder->ring);
+    }
+
     // when video is paused, then the current frame will be rendered with less
-    // ressources used. When not paused, it uses two always alternating buffers
-    // pixel buffer objects.
+    // ressources used. When not paused, frames are uploaded through a ring of
+    // persistent mapped pixel buffer objects (or the configured upload mode).
     if (!video->paused) {
 
-      if (video_container_get_frame(video, videoFrame)) {
-        // Sync the render loops framerate with the one from the given Video.
-        // Doing magic basically.
-        int64_t pts = videoFrame->frame->pts;
-        double timestamp =
-            pts *
-            av_q2d(
-                video->pFormatCtx->streams[video->videoStreamIndex]->time_base);
-
-        double current_time_sec = (double)(SDL_GetTicksNS() - start_time) / 1e9;
-        double audio_time_sec =
-            (double)(SDL_GetAudioStreamQueued(audioManager.audioStream)) /
-            (audioManager.audio->pCodecCtx->sample_rate *
-             audioManager.audio->pCodecCtx->ch_layout.nb_channels *
-             av_get_bytes_per_sample(
-                 audioManager.audio->pCodecCtx->sample_fmt));
-
-        double wait_time = timestamp - current_time_sec;
-
-        if (wait_time > 0.005) { // 5ms Toleranz
-          SDL_Delay((uint32_t)(wait_time * 1000));
-        } else if (audio_time_sec > timestamp) {
-          SDL_Delay((uint32_t)((audio_time_sec - timestamp) * 1000 / 2));
-        }
-
-        renderFrameWithPBO(&renderer, video->pCodecCtx->width,
-                           video->pCodecCtx->height, videoFrame);
+      // the decode thread already did the heavy work, only pick up the next
+      // frame when it is due.
+      vFrame *videoFrame = frame_ring_peek(videoDecoder->ring);
+      if (videoFrame && videoFrame->serial <= dropSerial) {
+        // decoded before a seek, the decoder already works on the new
+        // position
+        if (videoFrame->uploadSlot >= 0) {
+          frame_ring_advance(videoDecoder->ring);
+        } else {
+          frame_ring_pop(videoDecoder->ring);
+        }
+        continue;
+      }
+      if (videoFrame) {
+        // first frame after a seek
+        if (videoFrame->serial != frameSerial) {
+          frameSerial = videoFrame->serial;
+          start_time = SDL_GetTicksNS() - (uint64_t)(videoFrame->pts * 1e9);
+        }
+
+        // Audio is the master clock. Until audio of this serial is queued,
+        // the wall clock since the first frame is used.
+        double clockTime;
+        if (!playback_clock_get(&audioManager.clock, frameSerial, &clockTime)) {
+          clockTime = (double)(SDL_GetTicksNS() - start_time) / 1e9;
+        }
+
+        // the frame got late while waiting in the ring and the next one is
+        // ready, skip it without uploading and look at the next one
+        double delay = videoFrame->pts - clockTime;
+        if (delay < -videoDecoder->frameDuration &&
+            frame_ring_pending(videoDecoder->ring) > 1) {
+          if (videoFrame->uploadSlot >= 0) {
+            frame_ring_advance(videoDecoder->ring);
+          } else {
+            frame_ring_pop(videoDecoder->ring);
+          }
+          video_decoder_count_render_drop(videoDecoder);
+          continue;
+        }
+
+        // SDL_DelayPrecise spins the last bit, so the frame is presented
+        // within a fraction of a millisecond
+        if (delay > 0.0) {
+          SDL_DelayPrecise(
+              (Uint64)(SDL_min(delay, FRAME_MAX_WAIT) * SDL_NS_PER_SECOND));
+        }
+
+        if (delay > FRAME_MAX_WAIT) {
+          // not due yet, handle events first
+          renderFrameWithoutUpdate(&renderer);
+        } else {
+          renderVideoFrame(&renderer, videoFrame);
+
+          // time-to-first-frame, from the start of the worker on
+          if (startupStart) {
+            log_startup_step("first frame (total)", startupStart);
+            startupStart = 0;
+          }
+
+          // a frame inside its own PBO slot is held until the upload
+          // finished, otherwise the frame was copied and the slot can be
+          // reused
+          if (videoFrame->uploadSlot >= 0) {
+            frame_ring_advance(videoDecoder->ring);
+          } else {
+            frame_ring_pop(videoDecoder->ring);
+          }
+        }
       } else {
-        // When no frames avaiable anymore, start the video from the beginning
-        av_seek_frame(video->pFormatCtx, video->videoStreamIndex, 0,
-                      AVSEEK_FLAG_BACKWARD);
-        avcodec_flush_buffers(video->pCodecCtx);
-
-        av_seek_frame(audioManager.audio->pFormatCtx,
-                      audioManager.audio->audioStreamIndex, 0,
-                      AVSEEK_FLAG_BACKWARD);
-        avcodec_flush_buffers(audioManager.audio->pCodecCtx);
+        // decoder is behind, show the last frame again
+        renderFrameWithoutUpdate(&renderer);
       }
 
     } else {
@@ -214,15 +601,48 @@ int main(int argc, char *argv[]) {
       SDL_Delay(200);
     }
 
+    Uint64 traceStart = trace_now();
     SDL_GL_SwapWindow(window);
+    trace_event("SDL_GL_SwapWindow", traceStart);
+  }
+
+  VideoDecoderStats videoStats;
+  video_decoder_get_stats(videoDecoder, &videoStats);
+  printf("Video: %d frames decoded, %d dropped late, %d dropped before "
+         "upload.\n",
+         videoStats.decoded, videoStats.droppedLate, videoStats.droppedRender);
+  if (videoStats.poolFrames > 0) {
+    SDL_Log("HW transfer pool: %d frames, %d allocations.",
+            videoStats.poolFrames, videoStats.poolAllocations);
   }
+  printGpuTimes(&renderer);
+
+  AudioManagerStats audioStats;
+  audio_manager_get_stats(&audioManager, &audioStats);
+  printf("Audio: %d underruns, buffering %.0f ms, %.0f ms latency.\n",
+         audioStats.underruns, audioStats.targetMs, audioStats.latencyMs);
 
+  // releases the decoder threads if they are waiting for packets
+  demuxer_abort(demuxer);
+  video_decoder_destroy(videoDecoder);
   audio_manager_stop(&audioManager);
   audio_manager_cleanup(&audioManager);
-  free_video_frames(videoFrame);
   free_video_data(video);
+  demuxer_close(demuxer);
   cleanupRenderer(&renderer);
+  releaseRendererShaders();
+
+  // the picker process, the prefetch thread and their SDL objects go away
+  // before cleanupWindow shuts SDL down
+  media_picker_shutdown();
+  playlist_destroy(&playlist);
   cleanupWindow(window, glContext);
 
+  // all other threads are stopped, their rings don't change anymore
+  if (tracePath) {
+    trace_dump(tracePath);
+    trace_shutdown();
+  }
+
   return 0;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "mediaLoader.h"
 
+#include <libavutil/pixdesc.h>
+
 /**
  *                                                                    |
  *                                                                    |
@@ -11,6 +13,21 @@
 // hardware decoding format when detected
 static enum AVPixelFormat hw_pix_fmt = AV_PIX_FMT_NONE;
 
+// formats the renderer can upload as they are, the shader converts them to
+// RGB. Everything else is converted by swscale.
+static bool is_native_upload_format(enum AVPixelFormat format) {
+  return format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P ||
+         format == AV_PIX_FMT_YUV444P || format == AV_PIX_FMT_YUVJ444P ||
+         format == AV_PIX_FMT_NV12 || format == AV_PIX_FMT_YUV420P10 ||
+         format == AV_PIX_FMT_P010;
+}
+
+// 10-bit (and more) video, hardware decoders hand it out as P010
+static bool is_high_bit_depth(enum AVPixelFormat format) {
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+  return desc && desc->comp[0].depth > 8;
+}
+
 // Callback zum Auswählen des richtigen Hardware-Pixel-Formats
 enum AVPixelFormat get_hw_format(AVCodecContext *ctx,
                                  const enum AVPixelFormat *pix_fmts) {
@@ -24,8 +41,12 @@ enum AVPixelFormat get_hw_format(AVCodecContext *ctx,
   return AV_PIX_FMT_NONE;
 }
 
-VideoContainer *init_video_container(const char *filepath,
-                                     bool force_software) {
+VideoContainer *init_video_container(Demuxer *demuxer, bool force_software) {
+
+  if (demuxer->videoStreamIndex == -1) {
+    printf("No video-stream found.\n");
+    return NULL;
+  }
 
   // careful, heap! free the memory later.
   VideoContainer *video = (VideoContainer *)malloc(sizeof(VideoContainer));
@@ -34,47 +55,19 @@ VideoContainer *init_video_container(const char *filepath,
     return NULL;
   }
 
-  video->pFormatCtx = NULL;
+  // the demuxer owns the format context, the packets come from its video
+  // queue.
+  video->demuxer = demuxer;
+  video->pFormatCtx = demuxer->pFormatCtx;
   video->pCodecCtx = NULL;
-  video->videoStreamIndex = -1;
+  video->videoStreamIndex = demuxer->videoStreamIndex;
+  video->serial = -1;
+  video->looping = false;
   video->hw_device_ctx = NULL;
+  video->hw_frame_pool = NULL;
   video->hw_sws_ctx = NULL;
   video->paused = false;
 
-  // opens the video container. Puts information into pFormatCtx.
-  if (avformat_open_input(&video->pFormatCtx, filepath, NULL, NULL) != 0) {
-    printf("Could not open Videofile.\n");
-    free(video);
-    return NULL;
-  }
-
-  // find the stream information (I know these comments are amazing useful)
-  if (avformat_find_stream_info(video->pFormatCtx, NULL) < 0) {
-    printf("Could not find any stream-information.\n");
-    avformat_close_input(&video->pFormatCtx);
-    free(video);
-    return NULL;
-  }
-
-  // av_dump_format(video->pFormatCtx, 0, filepath, 0);
-
-  // iterates through all streams and sets the video StreamIndex to the first
-  // video stream found
-  for (int i = 0; i < video->pFormatCtx->nb_streams; i++) {
-    if (video->pFormatCtx->streams[i]->codecpar->codec_type ==
-        AVMEDIA_TYPE_VIDEO) {
-      video->videoStreamIndex = i;
-      break;
-    }
-  }
-
-  if (video->videoStreamIndex == -1) {
-    printf("No video-stream found.\n");
-    avformat_close_input(&video->pFormatCtx);
-    free(video);
-    return NULL;
-  }
-
   // finds the right decoder of the video. ffmpeg supports extremely many codecs
   // see: "ffmpeg -codecs"
   video->pCodec = avcodec_find_decoder(
@@ -82,7 +75,6 @@ VideoContainer *init_video_container(const char *filepath,
 
   if (!video->pCodec) {
     printf("Unsupported codec.\n");
-    avformat_close_input(&video->pFormatCtx);
     free(video);
     return NULL;
   }
@@ -128,18 +120,28 @@ VideoContainer *init_video_container(const char *filepath,
     if (video->hw_device_ctx)
       av_buffer_unref(&video->hw_device_ctx);
     avcodec_free_context(&video->pCodecCtx);
-    avformat_close_input(&video->pFormatCtx);
     free(video);
     return NULL;
   }
 
-  // AV_PIX_FMT_RGB24 look up others later
-  // This sws_ctx is used for software-decoded Frames
-  video->sws_ctx =
-      sws_getContext(video->pCodecCtx->width, video->pCodecCtx->height,
-                     video->pCodecCtx->pix_fmt, video->pCodecCtx->width,
-                     video->pCodecCtx->height, AV_PIX_FMT_RGB24,
-                     SWS_FAST_BILINEAR, NULL, NULL, NULL);
+  // Decide which format is uploaded to the GPU. YUV planes are uploaded as
+  // they are and converted in the fragment shader, which saves the sws_scale
+  // call and half of the upload bandwidth. Hardware decoded frames usually
+  // come back as NV12, or P010 for 10-bit video. 10-bit planes keep all their
+  // bits in 16-bit textures. Other formats still get converted to RGB24.
+  if (video->hw_device_ctx) {
+    // pix_fmt is still the software format of the stream here
+    video->upload_fmt = is_high_bit_depth(video->pCodecCtx->pix_fmt)
+                            ? AV_PIX_FMT_P010
+                            : AV_PIX_FMT_NV12;
+  } else if (is_native_upload_format(video->pCodecCtx->pix_fmt)) {
+    video->upload_fmt = video->pCodecCtx->pix_fmt;
+  } else {
+    video->upload_fmt = AV_PIX_FMT_RGB24;
+  }
+
+  // the sws contexts are created on the first frame that needs a conversion
+  video->sws_ctx = NULL;
 
   return video;
 }
@@ -153,107 +155,210 @@ vFrame *init_video_frames(VideoContainer *video) {
   }
 
   videoFrame->frame = av_frame_alloc();
+  videoFrame->swFrame = av_frame_alloc();
   videoFrame->frameYUV = av_frame_alloc();
   videoFrame->packet = av_packet_alloc();
+  videoFrame->imgBuffer = NULL;
+  videoFrame->uploadSlot = -1;
+  for (int i = 0; i < 4; i++) {
+    videoFrame->uploadData[i] = NULL;
+    videoFrame->uploadLinesize[i] = 0;
+  }
+  videoFrame->pts = 0.0;
+  videoFrame->serial = -1;
 
-  // reserves memory for the YUV-images and fills frameYUV with the necessary
-  // data
-  int numBytes = av_image_get_buffer_size(
-      AV_PIX_FMT_RGB24, video->pCodecCtx->width, video->pCodecCtx->height, 32);
-  videoFrame->imgBuffer = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
-
-  av_image_fill_arrays(videoFrame->frameYUV->data,
-                       videoFrame->frameYUV->linesize, videoFrame->imgBuffer,
-                       AV_PIX_FMT_RGB24, video->pCodecCtx->width,
-                       video->pCodecCtx->height, 32);
+  // imgBuffer is only allocated when a conversion is needed and the renderer
+  // has no PBO slot for the frame.
 
   return videoFrame;
 }
 
-int video_container_get_frame(VideoContainer *video, vFrame *videoFrame) {
+/**
+ * Fills videoFrame->frameYUV with the planes that get uploaded to the GPU.
+ *
+ * When the renderer reserved a persistent mapped PBO slot for the frame,
+ * swscale writes straight into it, or the planes are copied into it when the
+ * decoded frame already has the upload format. The render thread then only
+ * queues the upload, there is no copy through imgBuffer anymore.
+ *
+ * Without a slot, frameYUV just points to the decoded planes, or swscale
+ * converts the frame into imgBuffer.
+ */
+static bool convert_video_frame(VideoContainer *video, vFrame *videoFrame,
+                                AVFrame *src, struct SwsContext **sws_ctx) {
 
-  while (video->paused) {
-    SDL_Delay(10);
-  }
-  // Reads packages, until a frame could be  successfully decoded.
-  while (av_read_frame(video->pFormatCtx, videoFrame->packet) >= 0) {
-    if (videoFrame->packet->stream_index == video->videoStreamIndex) {
+  int width = video->pCodecCtx->width;
+  int height = video->pCodecCtx->height;
 
-      int send_status =
-          avcodec_send_packet(video->pCodecCtx, videoFrame->packet);
-      if (send_status < 0) {
-        printf("Error sending packet: %d\n", send_status);
-        av_packet_unref(videoFrame->packet);
-        continue; // try next package
-      }
+  if (videoFrame->uploadSlot >= 0) {
+    for (int i = 0; i < 4; i++) {
+      videoFrame->frameYUV->data[i] = videoFrame->uploadData[i];
+      videoFrame->frameYUV->linesize[i] = videoFrame->uploadLinesize[i];
+    }
 
-      int receive_status;
-      while ((receive_status = avcodec_receive_frame(video->pCodecCtx,
-                                                     videoFrame->frame)) == 0) {
-
-        // Use hardware decoding if frames are in the right format
-        if (video->hw_device_ctx && videoFrame->frame->format == hw_pix_fmt) {
-          AVFrame *sw_frame = av_frame_alloc();
-          if (!sw_frame) {
-            printf("Could not allocate data for hardware decoded frames.\n");
-            av_packet_unref(videoFrame->packet);
-            return 0;
-          }
-
-          if (av_hwframe_transfer_data(sw_frame, videoFrame->frame, 0) < 0) {
-            printf("Error transferring frame from GPU to system memory.\n");
-            av_frame_free(&sw_frame);
-            av_packet_unref(videoFrame->packet);
-            return 0;
-          }
-
-          if (!video->hw_sws_ctx) {
-
-            video->hw_sws_ctx = sws_getContext(
-                video->pCodecCtx->width, video->pCodecCtx->height,
-                sw_frame->format, video->pCodecCtx->width,
-                video->pCodecCtx->height, AV_PIX_FMT_RGB24, SWS_FAST_BILINEAR,
-                NULL, NULL, NULL);
-            if (!video->hw_sws_ctx) {
-              printf("Failed to create sws context for hardware decoded frame "
-                     "conversion.\n");
-              av_frame_free(&sw_frame);
-              av_packet_unref(videoFrame->packet);
-              return 0;
-            }
-          }
-
-          sws_scale(video->hw_sws_ctx, (const uint8_t *const *)sw_frame->data,
-                    sw_frame->linesize, 0, video->pCodecCtx->height,
-                    videoFrame->frameYUV->data, videoFrame->frameYUV->linesize);
-          av_frame_free(&sw_frame);
-        } else {
-          // Software-Decoding: use already existing sws_ctx
-          sws_scale(video->sws_ctx,
-                    (const uint8_t *const *)videoFrame->frame->data,
-                    videoFrame->frame->linesize, 0, video->pCodecCtx->height,
-                    videoFrame->frameYUV->data, videoFrame->frameYUV->linesize);
-        }
-
-        av_packet_unref(videoFrame->packet);
-        return 1; // frame decoded successfully. This fuction should always
-                  // return 1.
+    if (src->format == video->upload_fmt) {
+      Uint64 traceStart = trace_now();
+      av_image_copy(videoFrame->frameYUV->data, videoFrame->frameYUV->linesize,
+                    (const uint8_t **)src->data, src->linesize,
+                    video->upload_fmt, width, height);
+      trace_event("plane copy", traceStart);
+      return true;
+    }
+  } else if (src->format == video->upload_fmt) {
+    for (int i = 0; i < 4; i++) {
+      videoFrame->frameYUV->data[i] = src->data[i];
+      videoFrame->frameYUV->linesize[i] = src->linesize[i];
+    }
+    return true;
+  } else {
+    // only happens when the decoder changes its output format or there are
+    // no PBO slots, so the buffer is allocated once
+    if (!videoFrame->imgBuffer) {
+      int numBytes =
+          av_image_get_buffer_size(video->upload_fmt, width, height, 1);
+      videoFrame->imgBuffer = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
+      if (!videoFrame->imgBuffer) {
+        printf("VideoFrame - Memory allocation error.\n");
+        return false;
       }
+    }
+
+    // linesize without padding, so the renderer can copy the image in one go
+    av_image_fill_arrays(videoFrame->frameYUV->data,
+                         videoFrame->frameYUV->linesize, videoFrame->imgBuffer,
+                         video->upload_fmt, width, height, 1);
+  }
+
+  *sws_ctx = sws_getCachedContext(*sws_ctx, width, height, src->format, width,
+                                  height, video->upload_fmt, SWS_FAST_BILINEAR,
+                                  NULL, NULL, NULL);
+  if (!*sws_ctx) {
+    printf("Failed to create sws context for frame conversion.\n");
+    return false;
+  }
+
+  Uint64 traceStart = trace_now();
+  sws_scale(*sws_ctx, (const uint8_t *const *)src->data, src->linesize, 0,
+            height, videoFrame->frameYUV->data, videoFrame->frameYUV->linesize);
+  trace_event("sws_scale", traceStart);
+  return true;
+}
+
+int video_container_decode_frame(VideoContainer *video, vFrame *videoFrame) {
 
-      if (receive_status == AVERROR(EAGAIN)) {
-        // There are no frames in htis package avaiable anymore. Read the next
-        // package
-        av_packet_unref(videoFrame->packet);
-        continue;
-      } else if (receive_status != AVERROR_EOF) {
+  for (;;) {
+    // a packet can hold more than one frame, take those first
+    Uint64 traceStart = trace_now();
+    int receive_status =
+        avcodec_receive_frame(video->pCodecCtx, videoFrame->frame);
+    trace_event("video receive_frame", traceStart);
+    if (receive_status == 0) {
+      return 1;
+    }
+    if (receive_status == AVERROR_EOF && video->looping) {
+      // every frame before the loop point is out, the next pass starts
+      // with a clean decoder
+      avcodec_flush_buffers(video->pCodecCtx);
+      video->looping = false;
+    } else if (receive_status != AVERROR(EAGAIN)) {
+      if (receive_status != AVERROR_EOF) {
         printf("Error receiving frame: %d\n", receive_status);
-        av_packet_unref(videoFrame->packet);
-        return 0;
       }
+      return 0;
+    }
+
+    // The decoder needs more data, take the next packet from the demuxer
+    int serial;
+    int queue_status = packet_queue_get(&video->demuxer->videoQueue,
+                                        videoFrame->packet, &serial, true);
+    if (queue_status <= 0) {
+      // end of file (0) or the demuxer was aborted (-1)
+      return queue_status < 0 ? -1 : 0;
+    }
+
+    // the demuxer seeked, frames inside the decoder belong to the old
+    // position.
+    if (serial != video->serial) {
+      avcodec_flush_buffers(video->pCodecCtx);
+      video->serial = serial;
+      video->looping = false;
+    }
+
+    // the file starts over. The frames the decoder still holds are taken
+    // out first, right here on the decode thread.
+    if (queue_status == PACKET_QUEUE_LOOP) {
+      avcodec_send_packet(video->pCodecCtx, NULL);
+      video->looping = true;
+      continue;
+    }
+
+    traceStart = trace_now();
+    int send_status = avcodec_send_packet(video->pCodecCtx, videoFrame->packet);
+    trace_event("video send_packet", traceStart);
+    if (send_status < 0) {
+      printf("Error sending packet: %d\n", send_status);
     }
     av_packet_unref(videoFrame->packet);
   }
-  return 0;
+}
+
+bool video_container_convert_frame(VideoContainer *video, vFrame *videoFrame) {
+
+  // Use hardware decoding if frames are in the right format
+  if (video->hw_device_ctx && videoFrame->frame->format == hw_pix_fmt) {
+    av_frame_unref(videoFrame->swFrame);
+
+    // the transfer targets come from a pool sized like the surfaces of
+    // the decoder, it is replaced when the decoder recreates them
+    AVBufferRef *hw_frames_ctx = videoFrame->frame->hw_frames_ctx;
+    if (!video->hw_frame_pool ||
+        !frame_pool_matches(video->hw_frame_pool, hw_frames_ctx)) {
+      frame_pool_destroy(video->hw_frame_pool);
+      video->hw_frame_pool = frame_pool_create_for_hw(hw_frames_ctx);
+    }
+
+    Uint64 traceStart = trace_now();
+    bool transferred =
+        video->hw_frame_pool &&
+        frame_pool_transfer(video->hw_frame_pool, videoFrame->swFrame,
+                            videoFrame->frame) >= 0;
+    trace_event("hw transfer", traceStart);
+    if (!transferred) {
+      printf("Error transferring frame from GPU to system memory.\n");
+      return false;
+    }
+
+    // sws_ctx for Hardware-Decoding, only used if the transferred format
+    // is not the upload format
+    if (!convert_video_frame(video, videoFrame, videoFrame->swFrame,
+                             &video->hw_sws_ctx)) {
+      return false;
+    }
+
+    // converted into the PBO slot, the pooled frame can be reused now
+    if (videoFrame->uploadSlot >= 0) {
+      av_frame_unref(videoFrame->swFrame);
+    }
+    return true;
+  }
+
+  // Software-Decoding
+  return convert_video_frame(video, videoFrame, videoFrame->frame,
+                             &video->sws_ctx);
+}
+
+int video_container_get_frame(VideoContainer *video, vFrame *videoFrame) {
+
+  // Takes packets from the demuxer, until a frame could be successfully
+  // decoded and converted.
+  int ret;
+  while ((ret = video_container_decode_frame(video, videoFrame)) > 0) {
+    if (video_container_convert_frame(video, videoFrame)) {
+      return 1;
+    }
+  }
+
+  return ret;
 }
 
 void free_video_data(VideoContainer *video) {
@@ -262,15 +367,17 @@ void free_video_data(VideoContainer *video) {
     return;
   }
 
-  sws_freeContext(video->sws_ctx);
+  if (video->sws_ctx) {
+    sws_freeContext(video->sws_ctx);
+  }
   if (video->hw_sws_ctx) {
     sws_freeContext(video->hw_sws_ctx);
   }
+  frame_pool_destroy(video->hw_frame_pool);
   avcodec_free_context(&video->pCodecCtx);
   if (video->hw_device_ctx) {
     av_buffer_unref(&video->hw_device_ctx);
   }
-  avformat_close_input(&video->pFormatCtx);
   free(video);
 }
 
@@ -281,6 +388,7 @@ void free_video_frames(vFrame *videoFrame) {
   }
 
   av_frame_free(&videoFrame->frame);
+  av_frame_free(&videoFrame->swFrame);
   av_frame_free(&videoFrame->frameYUV);
   av_packet_free(&videoFrame->packet);
   av_free(videoFrame->imgBuffer);
@@ -303,55 +411,40 @@ void free_video_frames(vFrame *videoFrame) {
  *                                                                   |
  */
 
-AudioContainer *init_audio_container(const char *filepath) {
+AudioContainer *init_audio_container(Demuxer *demuxer) {
+  if (demuxer->audioStreamIndex == -1) {
+    fprintf(stderr, "No audio stream found.\n");
+    return NULL;
+  }
+
   AudioContainer *audio = (AudioContainer *)malloc(sizeof(AudioContainer));
   if (!audio) {
     fprintf(stderr, "AudioContainer - Memory allocation error.\n");
     return NULL;
   }
 
-  audio->pFormatCtx = NULL;
+  // shares the format context of the demuxer, packets come from its audio
+  // queue.
+  audio->demuxer = demuxer;
+  audio->pFormatCtx = demuxer->pFormatCtx;
   audio->pCodecCtx = NULL;
   audio->pCodec = NULL;
-  audio->audioStreamIndex = -1;
-  audio->paused = false;
+  audio->audioStreamIndex = demuxer->audioStreamIndex;
+  audio->serial = -1;
+  audio->next_pts = 0.0;
+  audio->draining = false;
+  audio->flushed = false;
+  audio->looping = false;
+  audio->loopGap = false;
+  audio->trimming = false;
+  audio->trim_pts = 0.0;
   audio->swr_ctx = NULL;
 
-  // Open the audio file.
-  if (avformat_open_input(&audio->pFormatCtx, filepath, NULL, NULL) != 0) {
-    fprintf(stderr, "Could not open audio file.\n");
-    free(audio);
-    return NULL;
-  }
-
-  if (avformat_find_stream_info(audio->pFormatCtx, NULL) < 0) {
-    fprintf(stderr, "Could not find stream information.\n");
-    avformat_close_input(&audio->pFormatCtx);
-    free(audio);
-    return NULL;
-  }
-
-  // Locate the first audio stream.
-  for (unsigned int i = 0; i < audio->pFormatCtx->nb_streams; i++) {
-    if (audio->pFormatCtx->streams[i]->codecpar->codec_type ==
-        AVMEDIA_TYPE_AUDIO) {
-      audio->audioStreamIndex = i;
-      break;
-    }
-  }
-  if (audio->audioStreamIndex == -1) {
-    fprintf(stderr, "No audio stream found.\n");
-    avformat_close_input(&audio->pFormatCtx);
-    free(audio);
-    return NULL;
-  }
-
   // Find and open the decoder.
   audio->pCodec = avcodec_find_decoder(
       audio->pFormatCtx->streams[audio->audioStreamIndex]->codecpar->codec_id);
   if (!audio->pCodec) {
     fprintf(stderr, "Unsupported audio codec.\n");
-    avformat_close_input(&audio->pFormatCtx);
     free(audio);
     return NULL;
   }
@@ -359,7 +452,6 @@ AudioContainer *init_audio_container(const char *filepath) {
   audio->pCodecCtx = avcodec_alloc_context3(audio->pCodec);
   if (!audio->pCodecCtx) {
     fprintf(stderr, "Could not allocate audio codec context.\n");
-    avformat_close_input(&audio->pFormatCtx);
     free(audio);
     return NULL;
   }
@@ -369,7 +461,6 @@ AudioContainer *init_audio_container(const char *filepath) {
           audio->pFormatCtx->streams[audio->audioStreamIndex]->codecpar) < 0) {
     fprintf(stderr, "Failed to copy audio codec parameters.\n");
     avcodec_free_context(&audio->pCodecCtx);
-    avformat_close_input(&audio->pFormatCtx);
     free(audio);
     return NULL;
   }
@@ -377,7 +468,6 @@ AudioContainer *init_audio_container(const char *filepath) {
   if (avcodec_open2(audio->pCodecCtx, audio->pCodec, NULL) < 0) {
     fprintf(stderr, "Could not open audio codec.\n");
     avcodec_free_context(&audio->pCodecCtx);
-    avformat_close_input(&audio->pFormatCtx);
     free(audio);
     return NULL;
   }
@@ -387,7 +477,6 @@ AudioContainer *init_audio_container(const char *filepath) {
   if (!audio->swr_ctx) {
     fprintf(stderr, "Could not allocate resampler context.\n");
     avcodec_free_context(&audio->pCodecCtx);
-    avformat_close_input(&audio->pFormatCtx);
     free(audio);
     return NULL;
   }
@@ -420,7 +509,6 @@ AudioContainer *init_audio_container(const char *filepath) {
     fprintf(stderr, "Failed to set options for the resampling context.\n");
     swr_free(&audio->swr_ctx);
     avcodec_free_context(&audio->pCodecCtx);
-    avformat_close_input(&audio->pFormatCtx);
     free(audio);
     return NULL;
   }
@@ -429,7 +517,6 @@ AudioContainer *init_audio_container(const char *filepath) {
     fprintf(stderr, "Failed to initialize the resampling context.\n");
     swr_free(&audio->swr_ctx);
     avcodec_free_context(&audio->pCodecCtx);
-    avformat_close_input(&audio->pFormatCtx);
     free(audio);
     return NULL;
   }
@@ -448,78 +535,202 @@ aFrame *init_audio_frames(AudioContainer *audio) {
   audioFrame->packet = av_packet_alloc();
   audioFrame->convertedData = NULL;
   audioFrame->convertedDataSize = 0;
+  audioFrame->convertedCapacity = 0;
+  audioFrame->end_pts = 0.0;
+  audioFrame->serial = -1;
   return audioFrame;
 }
 
-int audio_container_get_frame(AudioContainer *audio, aFrame *audioFrame) {
-  // If paused, wait.
-  while (audio->paused) {
-    SDL_Delay(10);
+// converts a decoded frame (or, with NULL, the samples the resampler still
+// holds) and appends the result to the staged samples
+static bool stage_audio_frame(AudioContainer *audio, aFrame *audioFrame,
+                              AVFrame *frame) {
+  int sample_rate = audio->pCodecCtx->sample_rate;
+  int in_samples = frame ? frame->nb_samples : 0;
+
+  double start = audio->next_pts;
+  int gap_samples = 0;
+  if (frame) {
+    AVRational time_base =
+        audio->pFormatCtx->streams[audio->audioStreamIndex]->time_base;
+    int64_t pts = frame->best_effort_timestamp;
+    if (pts != AV_NOPTS_VALUE) {
+      start = pts * av_q2d(time_base);
+    }
+
+    // the audio of a pass can end before its video does. The next pass
+    // starts after the video, that time is filled with silence so audio
+    // and video stay together loop after loop.
+    if (audio->loopGap) {
+      audio->loopGap = false;
+      double missing = start - audio->next_pts;
+      if (missing > 0.0 && missing < 1.0) {
+        gap_samples = (int)(missing * sample_rate + 0.5);
+      }
+    }
+    audio->next_pts = start + (double)in_samples / sample_rate;
+
+    // frames that end before the seek target are never converted
+    if (audio->trimming && audio->next_pts <= audio->trim_pts) {
+      return true;
+    }
   }
 
-  // Read packets until an audio frame is decoded.
-  while (av_read_frame(audio->pFormatCtx, audioFrame->packet) >= 0) {
-    if (audioFrame->packet->stream_index == audio->audioStreamIndex) {
-      int ret = avcodec_send_packet(audio->pCodecCtx, audioFrame->packet);
-      if (ret < 0) {
-        fprintf(stderr, "Error sending audio packet: %d\n", ret);
-        av_packet_unref(audioFrame->packet);
-        continue;
+  // upper bound of what swr_convert can output, including the samples
+  // still buffered in the resampler
+  int out_samples = swr_get_out_samples(audio->swr_ctx, in_samples);
+  if (out_samples <= 0) {
+    return true;
+  }
+
+  // stereo F32, packed. The block only grows, after the first few
+  // chunks there is no allocation anymore.
+  int bytes_per_sample = 2 * av_get_bytes_per_sample(AV_SAMPLE_FMT_FLT);
+  size_t needed = (size_t)audioFrame->convertedDataSize +
+                  (size_t)(gap_samples + out_samples) * bytes_per_sample;
+  uint8_t *data = (uint8_t *)av_fast_realloc(
+      audioFrame->convertedData, &audioFrame->convertedCapacity, needed);
+  if (!data) {
+    fprintf(stderr, "Could not allocate converted samples buffer.\n");
+    return false;
+  }
+  audioFrame->convertedData = data;
+
+  if (gap_samples > 0) {
+    memset(data + audioFrame->convertedDataSize, 0,
+           (size_t)gap_samples * bytes_per_sample);
+    audioFrame->convertedDataSize += gap_samples * bytes_per_sample;
+  }
+
+  uint8_t *out[1] = {data + audioFrame->convertedDataSize};
+  Uint64 traceStart = trace_now();
+  int nb_converted =
+      swr_convert(audio->swr_ctx, out, out_samples,
+                  frame ? (const uint8_t **)frame->data : NULL, in_samples);
+  trace_event("swr_convert", traceStart);
+  if (nb_converted < 0) {
+    fprintf(stderr, "Error while converting audio samples.\n");
+    return false;
+  }
+
+  // the frame that contains the seek target, its leading samples go. The
+  // output has the sample rate of the input.
+  if (audio->trimming && frame) {
+    int skip = (int)((audio->trim_pts - start) * sample_rate + 0.5);
+    skip = SDL_clamp(skip, 0, nb_converted);
+    memmove(out[0], out[0] + (size_t)skip * bytes_per_sample,
+            (size_t)(nb_converted - skip) * bytes_per_sample);
+    nb_converted -= skip;
+    audio->trimming = false;
+  }
+  audioFrame->convertedDataSize += nb_converted * bytes_per_sample;
+
+  // pts after the last staged sample, samples still buffered inside the
+  // resampler are not part of it
+  audioFrame->end_pts =
+      audio->next_pts -
+      (double)swr_get_delay(audio->swr_ctx, sample_rate) / sample_rate;
+  audioFrame->serial = audio->serial;
+  return true;
+}
+
+int audio_container_decode_samples(AudioContainer *audio, aFrame *audioFrame,
+                                   int wanted) {
+  PacketQueue *queue = &audio->demuxer->audioQueue;
+  audioFrame->convertedDataSize = 0;
+
+  while (audioFrame->convertedDataSize < wanted) {
+
+    // a packet can hold several frames and some codecs buffer frames
+    // internally, so every frame the decoder has is taken first
+    Uint64 traceStart = trace_now();
+    int ret = avcodec_receive_frame(audio->pCodecCtx, audioFrame->frame);
+    trace_event("audio receive_frame", traceStart);
+    if (ret == 0) {
+      bool staged = stage_audio_frame(audio, audioFrame, audioFrame->frame);
+      av_frame_unref(audioFrame->frame);
+      if (!staged) {
+        break;
       }
-      ret = avcodec_receive_frame(audio->pCodecCtx, audioFrame->frame);
-      if (ret == 0) {
-        if (audioFrame->convertedData) {
-          av_freep(&audioFrame->convertedData[0]);
-          free(audioFrame->convertedData);
-          audioFrame->convertedData = NULL;
-        }
-        int dst_nb_samples = av_rescale_rnd(
-            swr_get_delay(audio->swr_ctx, audio->pCodecCtx->sample_rate) +
-                audioFrame->frame->nb_samples,
-            audio->pCodecCtx->sample_rate, audio->pCodecCtx->sample_rate,
-            AV_ROUND_UP);
-
-        int ret_alloc = av_samples_alloc_array_and_samples(
-            &audioFrame->convertedData, NULL,
-            2, // output channels (stereo)
-            dst_nb_samples, AV_SAMPLE_FMT_FLT, 0);
-        if (ret_alloc < 0) {
-          fprintf(stderr, "Could not allocate converted samples buffer.\n");
-          av_packet_unref(audioFrame->packet);
-          return 0;
-        }
-
-        int nb_converted = swr_convert(
-            audio->swr_ctx, audioFrame->convertedData, dst_nb_samples,
-            (const uint8_t **)audioFrame->frame->data,
-            audioFrame->frame->nb_samples);
-        if (nb_converted < 0) {
-          fprintf(stderr, "Error while converting audio samples.\n");
-          av_packet_unref(audioFrame->packet);
-          return 0;
-        }
-
-        int size = av_samples_get_buffer_size(NULL, 2, nb_converted,
-                                              AV_SAMPLE_FMT_FLT, 1);
-        audioFrame->convertedDataSize = size;
-
-        av_packet_unref(audioFrame->packet);
-        return 1;
-      } else if (ret == AVERROR(EAGAIN)) {
-        av_packet_unref(audioFrame->packet);
-        continue;
-      } else if (ret == AVERROR_EOF) {
-        av_packet_unref(audioFrame->packet);
-        return 0;
-      } else {
-        fprintf(stderr, "Error receiving audio frame: %d\n", ret);
-        av_packet_unref(audioFrame->packet);
-        return 0;
+      continue;
+    }
+
+    if (ret == AVERROR_EOF && audio->looping) {
+      // everything before the loop point is staged. The resampler keeps
+      // its state, the samples of both passes follow each other directly.
+      avcodec_flush_buffers(audio->pCodecCtx);
+      audio->looping = false;
+      audio->loopGap = true;
+      continue;
+    }
+
+    if (ret == AVERROR_EOF) {
+      // the decoder is drained, the tail inside the resampler comes last
+      if (!audio->flushed) {
+        audio->flushed = true;
+        stage_audio_frame(audio, audioFrame, NULL);
       }
+    } else if (ret != AVERROR(EAGAIN)) {
+      fprintf(stderr, "Error receiving audio frame: %d\n", ret);
+      break;
+    }
+
+    // The decoder needs more data. Without anything staged yet this waits
+    // for the demuxer, otherwise the staged samples are queued first.
+    int serial;
+    int queue_status = packet_queue_get(queue, audioFrame->packet, &serial,
+                                        audioFrame->convertedDataSize == 0);
+    if (queue_status == -1) {
+      // the demuxer was aborted
+      return -1;
+    }
+    if (queue_status == -2) {
+      break;
+    }
+
+    if (queue_status == 0) {
+      // end of file, the decoder gives out the frames it still holds
+      if (audio->draining) {
+        break;
+      }
+      avcodec_send_packet(audio->pCodecCtx, NULL);
+      audio->draining = true;
+      continue;
+    }
+
+    // first packet after a seek. The samples of the old position that are
+    // still staged are dropped too.
+    if (serial != audio->serial) {
+      avcodec_flush_buffers(audio->pCodecCtx);
+      swr_init(audio->swr_ctx);
+      audio->serial = serial;
+      audio->next_pts = 0.0;
+      audio->draining = false;
+      audio->flushed = false;
+      audio->looping = false;
+      audio->loopGap = false;
+      audioFrame->convertedDataSize = 0;
+      audio->trimming = demuxer_get_seek_target(audio->demuxer, queue, serial,
+                                                &audio->trim_pts);
+    }
+
+    // the file starts over, the decoder hands out what it still holds
+    if (queue_status == PACKET_QUEUE_LOOP) {
+      avcodec_send_packet(audio->pCodecCtx, NULL);
+      audio->looping = true;
+      continue;
+    }
+
+    traceStart = trace_now();
+    ret = avcodec_send_packet(audio->pCodecCtx, audioFrame->packet);
+    trace_event("audio send_packet", traceStart);
+    if (ret < 0) {
+      fprintf(stderr, "Error sending audio packet: %d\n", ret);
     }
     av_packet_unref(audioFrame->packet);
   }
-  return 0;
+
+  return audioFrame->convertedDataSize > 0 ? 1 : 0;
 }
 
 void free_audio_data(AudioContainer *audio) {
@@ -529,8 +740,6 @@ void free_audio_data(AudioContainer *audio) {
     swr_free(&audio->swr_ctx);
   if (audio->pCodecCtx)
     avcodec_free_context(&audio->pCodecCtx);
-  if (audio->pFormatCtx)
-    avformat_close_input(&audio->pFormatCtx);
   free(audio);
 }
 
@@ -541,10 +750,7 @@ void free_audio_frames(aFrame *audioFrame) {
     av_frame_free(&audioFrame->frame);
   if (audioFrame->packet)
     av_packet_free(&audioFrame->packet);
-  if (audioFrame->convertedData) {
-    av_freep(&audioFrame->convertedData[0]);
-    free(audioFrame->convertedData);
-  }
+  av_freep(&audioFrame->convertedData);
   free(audioFrame);
 }
 
@@ -1,11 +1,18 @@
 
 #include <mediaPicker.h>
 
+// the dialog running right now, so it can be closed on shutdown
+static SDL_Process *pickerProcess = NULL;
+static SDL_SpinLock pickerLock = 0;
+
+// the picker thread of media_picker_open_async
+static SDL_Thread *pickerThread = NULL;
+static SDL_AtomicInt pickerRunning;
+static PlaybackClock *pickerClock = NULL;
+static Uint32 pickerEventType = 0;
+
 // implementation on KDE Plasma , might add more later
 char *KDE_Plasma_select_video_file(void) {
-  char buffer[1024] = {0};
-  char command[1200];
-
   char *home_path = getenv("HOME");
   if (!home_path) {
     SDL_Log("Could not get the home directory.");
@@ -13,102 +20,166 @@ char *KDE_Plasma_select_video_file(void) {
     return NULL;
   }
 
-  // to open kdialog on KDE plasma
-  snprintf(command, sizeof(command),
-           "kdialog --getopenfilename \"%s\" \"Videos (*.mp4 *.mkv *.avi *.mov "
-           "*.webm *.flv)\"",
-           home_path);
-
-  // opens the shell with the command above
-  FILE *fp = popen(command, "r");
-  if (!fp) {
-    SDL_Log("Error: popen() failed.");
+  // kdialog is started directly, without a shell in between
+  const char *args[] = {"kdialog", "--getopenfilename", home_path,
+                        "Videos (*.mp4 *.mkv *.avi *.mov *.webm *.flv)",
+                        NULL};
+  SDL_Process *process = SDL_CreateProcess(args, true);
+  if (!process) {
+    SDL_Log("Error: could not start kdialog: %s", SDL_GetError());
     return NULL;
   }
 
-  if (!fgets(buffer, sizeof(buffer), fp)) {
+  SDL_LockSpinlock(&pickerLock);
+  pickerProcess = process;
+  SDL_UnlockSpinlock(&pickerLock);
+
+  // waits until the dialog is closed
+  size_t size = 0;
+  int exitcode = -1;
+  char *output = (char *)SDL_ReadProcess(process, &size, &exitcode);
+
+  SDL_LockSpinlock(&pickerLock);
+  pickerProcess = NULL;
+  SDL_UnlockSpinlock(&pickerLock);
+  SDL_DestroyProcess(process);
+
+  if (!output || exitcode != 0) {
     SDL_Log("Error: No file selected.");
-    pclose(fp);
+    SDL_free(output);
     return NULL;
   }
-  pclose(fp);
 
-  buffer[strcspn(buffer, "\n")] = '\0';
+  output[strcspn(output, "\n")] = '\0';
 
-  if (strlen(buffer) == 0) {
+  if (strlen(output) == 0) {
     SDL_Log("Error: No supported files selected.");
+    SDL_free(output);
     return NULL;
   }
 
-  char *filename = malloc(strlen(buffer) + 1);
+  char *filename = malloc(strlen(output) + 1);
   if (filename)
-    strcpy(filename, buffer);
+    strcpy(filename, output);
+  SDL_free(output);
 
   return filename;
 }
 
-/**
- * returns true if new file was selected.
- * Returns false when either no file was selected or the video/videoFrame setup
- * failed.
- */
-bool reload_video_and_audio(VideoContainer **video, vFrame **videoFrame,
-                            AudioManager *audioManager, uint64_t *start_time) {
+Uint32 media_picker_event_type(void) {
+  if (pickerEventType == 0) {
+    pickerEventType = SDL_RegisterEvents(1);
+  }
+  return pickerEventType;
+}
 
-  // Select new file first
-  char *new_video_file = KDE_Plasma_select_video_file();
-  if (!new_video_file || new_video_file[0] == '\0') {
+static int picker_thread_func(void *data) {
+  (void)data;
 
-    if (new_video_file) {
-      free(new_video_file);
-    }
+  // the file is also opened and probed here, the render loop only switches
+  PreparedMedia *media = NULL;
+  char *file = KDE_Plasma_select_video_file();
+  if (file) {
+    media = media_prepare(file, pickerClock, true);
+    free(file);
+  }
 
-    return false;
+  SDL_Event event;
+  SDL_zero(event);
+  event.type = media_picker_event_type();
+  event.user.data1 = media;
+  if (!SDL_PushEvent(&event)) {
+    media_prepared_free(media);
   }
 
-  audio_manager_stop(audioManager);
-  audio_manager_cleanup(audioManager);
+  SDL_SetAtomicInt(&pickerRunning, 0);
+  return 0;
+}
 
-  if (audio_manager_init(audioManager, new_video_file) < 0) {
-    SDL_Log("Failed to initialize audio manager");
-    free(new_video_file);
+bool media_picker_open_async(PlaybackClock *clock) {
+  // one dialog at a time
+  if (!SDL_CompareAndSwapAtomicInt(&pickerRunning, 0, 1)) {
     return false;
   }
 
-  if (*video) {
-    free_video_data(*video);
+  // the last picker is done already, this only releases its thread
+  if (pickerThread) {
+    SDL_WaitThread(pickerThread, NULL);
+  }
 
-    *video = NULL;
+  media_picker_event_type();
+  pickerClock = clock;
+  pickerThread = SDL_CreateThread(picker_thread_func, "PickerThread", NULL);
+  if (!pickerThread) {
+    SDL_Log("Failed to create picker thread: %s", SDL_GetError());
+    SDL_SetAtomicInt(&pickerRunning, 0);
+    return false;
   }
+  return true;
+}
 
-  if (*videoFrame) {
-    free_video_frames(*videoFrame);
+void media_picker_shutdown(void) {
+  // an open dialog is closed, the thread finishes right after
+  SDL_LockSpinlock(&pickerLock);
+  if (pickerProcess) {
+    SDL_KillProcess(pickerProcess, false);
+  }
+  SDL_UnlockSpinlock(&pickerLock);
 
-    *videoFrame = NULL;
+  if (pickerThread) {
+    SDL_WaitThread(pickerThread, NULL);
+    pickerThread = NULL;
   }
 
-  *video = init_video_container(new_video_file, false);
+  // a file that was picked but never played
+  if (pickerEventType != 0) {
+    SDL_Event event;
+    while (SDL_PeepEvents(&event, 1, SDL_GETEVENT, pickerEventType,
+                          pickerEventType) > 0) {
+      media_prepared_free((PreparedMedia *)event.user.data1);
+    }
+  }
+}
 
-  if (!*video) {
-    SDL_Log("Failed to initialize new video container.");
-    free(new_video_file);
-    return false;
+/**
+ * Stops the current file and takes over the threads and containers of next.
+ * Only joins threads and frees, the new file was opened and probed before.
+ * The new video decoder is not started yet, the caller attaches its frame
+ * ring to the renderer first. next is freed, also when this fails.
+ */
+bool switch_media(PreparedMedia *next, Demuxer **demuxer,
+                  VideoContainer **video, VideoDecoder **videoDecoder,
+                  AudioManager *audioManager) {
+
+  // the decoder threads might wait for packets of the old demuxer
+  demuxer_abort(*demuxer);
+  audio_manager_stop(audioManager);
+  audio_manager_cleanup(audioManager);
+
+  if (*videoDecoder) {
+    video_decoder_destroy(*videoDecoder);
+
+    *videoDecoder = NULL;
   }
 
-  *videoFrame = init_video_frames(*video);
-  if (!*videoFrame) {
-    SDL_Log("Failed to initialize new video frames.");
+  if (*video) {
     free_video_data(*video);
+
     *video = NULL;
-    free(new_video_file);
-    return false;
   }
 
-  *start_time = SDL_GetTicksNS();
+  demuxer_close(*demuxer);
 
-  free(new_video_file);
+  SDL_Log("Playing %s", next->path);
+  AudioContainer *audio;
+  media_prepared_take(next, demuxer, video, videoDecoder, &audio);
+
+  if (audio_manager_init_container(audioManager, audio) < 0) {
+    SDL_Log("Failed to initialize audio manager");
+    return false;
+  }
 
   audio_manager_start(audioManager);
 
   return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,234 @@
+#include "packetQueue.h"
+
+int packet_queue_init(PacketQueue *q, AVRational time_base, int64_t max_bytes,
+                      double max_duration) {
+  memset(q, 0, sizeof(PacketQueue));
+
+  q->time_base = time_base;
+  q->max_bytes = max_bytes;
+  q->max_duration = max_duration;
+
+  q->mutex = SDL_CreateMutex();
+  q->cond = SDL_CreateCondition();
+  if (!q->mutex || !q->cond) {
+    SDL_Log("PacketQueue - could not create mutex/condition: %s",
+            SDL_GetError());
+    packet_queue_destroy(q);
+    return -1;
+  }
+
+  return 0;
+}
+
+// without locking, caller holds the mutex
+static void packet_queue_clear(PacketQueue *q) {
+  PacketNode *node = q->first;
+  while (node) {
+    PacketNode *next = node->next;
+    av_packet_free(&node->packet);
+    free(node);
+    node = next;
+  }
+  q->first = NULL;
+  q->last = NULL;
+  q->nb_packets = 0;
+  q->size = 0;
+  q->duration = 0;
+}
+
+void packet_queue_destroy(PacketQueue *q) {
+  packet_queue_clear(q);
+  if (q->cond) {
+    SDL_DestroyCondition(q->cond);
+    q->cond = NULL;
+  }
+  if (q->mutex) {
+    SDL_DestroyMutex(q->mutex);
+    q->mutex = NULL;
+  }
+}
+
+// appends node, takes the mutex itself
+static void packet_queue_append(PacketQueue *q, PacketNode *node) {
+  node->next = NULL;
+
+  SDL_LockMutex(q->mutex);
+
+  node->serial = q->serial;
+  if (q->last) {
+    q->last->next = node;
+  } else {
+    q->first = node;
+  }
+  q->last = node;
+
+  q->nb_packets++;
+  q->size += node->packet->size;
+  q->duration += node->packet->duration;
+
+  SDL_SignalCondition(q->cond);
+  SDL_UnlockMutex(q->mutex);
+}
+
+int packet_queue_put(PacketQueue *q, AVPacket *packet) {
+  PacketNode *node = (PacketNode *)malloc(sizeof(PacketNode));
+  if (!node) {
+    av_packet_unref(packet);
+    return -1;
+  }
+
+  node->packet = av_packet_alloc();
+  if (!node->packet) {
+    free(node);
+    av_packet_unref(packet);
+    return -1;
+  }
+  av_packet_move_ref(node->packet, packet);
+  node->loop = false;
+
+  packet_queue_append(q, node);
+  return 0;
+}
+
+int packet_queue_put_loop(PacketQueue *q) {
+  PacketNode *node = (PacketNode *)malloc(sizeof(PacketNode));
+  if (!node) {
+    return -1;
+  }
+
+  // an empty packet, so size and duration stay right
+  node->packet = av_packet_alloc();
+  if (!node->packet) {
+    free(node);
+    return -1;
+  }
+  node->loop = true;
+
+  packet_queue_append(q, node);
+  return 0;
+}
+
+void packet_queue_set_producer(PacketQueue *q, SDL_Mutex *mutex,
+                               SDL_Condition *cond) {
+  q->producer_mutex = mutex;
+  q->producer_cond = cond;
+}
+
+// caller holds q->mutex
+static bool packet_queue_full_locked(PacketQueue *q) {
+  return q->size >= q->max_bytes ||
+         q->duration * av_q2d(q->time_base) >= q->max_duration;
+}
+
+int packet_queue_get(PacketQueue *q, AVPacket *packet, int *serial,
+                     bool block) {
+  int ret;
+  bool madeRoom = false;
+
+  SDL_LockMutex(q->mutex);
+  for (;;) {
+    if (q->abort) {
+      ret = -1;
+      break;
+    }
+
+    PacketNode *node = q->first;
+    if (node) {
+      madeRoom = packet_queue_full_locked(q);
+      q->first = node->next;
+      if (!q->first) {
+        q->last = NULL;
+      }
+      q->nb_packets--;
+      q->size -= node->packet->size;
+      q->duration -= node->packet->duration;
+
+      av_packet_move_ref(packet, node->packet);
+      if (serial) {
+        *serial = node->serial;
+      }
+      ret = node->loop ? PACKET_QUEUE_LOOP : 1;
+      av_packet_free(&node->packet);
+      free(node);
+      break;
+    }
+
+    if (q->eof) {
+      ret = 0;
+      break;
+    }
+
+    if (!block) {
+      ret = -2;
+      break;
+    }
+
+    SDL_WaitCondition(q->cond, q->mutex);
+  }
+  SDL_UnlockMutex(q->mutex);
+
+  // outside of q->mutex, the producer holds its own mutex while it asks the
+  // queues. Taken before signaling, so the wakeup can't fall between its
+  // check and its wait.
+  if (madeRoom && q->producer_cond) {
+    SDL_LockMutex(q->producer_mutex);
+    SDL_SignalCondition(q->producer_cond);
+    SDL_UnlockMutex(q->producer_mutex);
+  }
+
+  return ret;
+}
+
+void packet_queue_flush(PacketQueue *q) {
+  SDL_LockMutex(q->mutex);
+  packet_queue_clear(q);
+  q->serial++;
+  q->eof = false;
+  SDL_UnlockMutex(q->mutex);
+}
+
+void packet_queue_set_eof(PacketQueue *q, bool eof) {
+  SDL_LockMutex(q->mutex);
+  q->eof = eof;
+  SDL_BroadcastCondition(q->cond);
+  SDL_UnlockMutex(q->mutex);
+}
+
+void packet_queue_abort(PacketQueue *q) {
+  SDL_LockMutex(q->mutex);
+  q->abort = true;
+  SDL_BroadcastCondition(q->cond);
+  SDL_UnlockMutex(q->mutex);
+}
+
+bool packet_queue_is_full(PacketQueue *q) {
+  SDL_LockMutex(q->mutex);
+  bool full = packet_queue_full_locked(q);
+  SDL_UnlockMutex(q->mutex);
+
+  return full;
+}
+
+int64_t packet_queue_size(PacketQueue *q) {
+  SDL_LockMutex(q->mutex);
+  int64_t size = q->size;
+  SDL_UnlockMutex(q->mutex);
+
+  return size;
+}
+
+int packet_queue_count(PacketQueue *q) {
+  SDL_LockMutex(q->mutex);
+  int count = q->nb_packets;
+  SDL_UnlockMutex(q->mutex);
+
+  return count;
+}
+
+int packet_queue_serial(PacketQueue *q) {
+  SDL_LockMutex(q->mutex);
+  int serial = q->serial;
+  SDL_UnlockMutex(q->mutex);
+
+  return serial;
+}
@@ -0,0 +1,144 @@
+#include "pcmRing.h"
+
+#include <string.h>
+
+PcmRing *pcm_ring_create(int minBytes, int bytesPerSecond) {
+  PcmRing *ring = (PcmRing *)calloc(1, sizeof(PcmRing));
+  if (!ring) {
+    SDL_Log("PcmRing - Memory allocation error.");
+    return NULL;
+  }
+
+  // a power of two, so the position stays right when the counters overflow
+  Uint32 capacity = 4096;
+  while (capacity < (Uint32)minBytes && capacity < 0x40000000u) {
+    capacity *= 2;
+  }
+
+  ring->data = (uint8_t *)malloc(capacity);
+  ring->space = SDL_CreateSemaphore(0);
+  if (!ring->data || !ring->space) {
+    SDL_Log("PcmRing - Memory allocation error.");
+    pcm_ring_destroy(ring);
+    return NULL;
+  }
+  ring->capacity = capacity;
+  ring->bytesPerSecond = bytesPerSecond;
+
+  SDL_SetAtomicU32(&ring->readIndex, 0);
+  SDL_SetAtomicU32(&ring->writeIndex, 0);
+  SDL_SetAtomicU32(&ring->discardIndex, 0);
+  SDL_SetAtomicU32(&ring->markRead, 0);
+  SDL_SetAtomicU32(&ring->markWrite, 0);
+
+  return ring;
+}
+
+void pcm_ring_destroy(PcmRing *ring) {
+  if (!ring) {
+    return;
+  }
+  if (ring->space) {
+    SDL_DestroySemaphore(ring->space);
+  }
+  free(ring->data);
+  free(ring);
+}
+
+int pcm_ring_buffered(PcmRing *ring) {
+  return (int)(SDL_GetAtomicU32(&ring->writeIndex) -
+               SDL_GetAtomicU32(&ring->readIndex));
+}
+
+int pcm_ring_space(PcmRing *ring) {
+  Uint32 marks =
+      SDL_GetAtomicU32(&ring->markWrite) - SDL_GetAtomicU32(&ring->markRead);
+  if (marks >= PCM_RING_MARKS) {
+    return 0;
+  }
+  return (int)(ring->capacity - (Uint32)pcm_ring_buffered(ring));
+}
+
+bool pcm_ring_write(PcmRing *ring, const uint8_t *data, int size,
+                    double endPts, int serial) {
+  if (size <= 0 || size > pcm_ring_space(ring)) {
+    return false;
+  }
+
+  Uint32 write = SDL_GetAtomicU32(&ring->writeIndex);
+  Uint32 offset = write & (ring->capacity - 1);
+  Uint32 first = SDL_min((Uint32)size, ring->capacity - offset);
+  memcpy(ring->data + offset, data, first);
+  memcpy(ring->data, data + first, size - first);
+
+  // the mark is published before the bytes, the consumer never sees bytes
+  // without their mark
+  Uint32 markWrite = SDL_GetAtomicU32(&ring->markWrite);
+  PcmMark *mark = &ring->marks[markWrite % PCM_RING_MARKS];
+  mark->end = write + size;
+  mark->endPts = endPts;
+  mark->serial = serial;
+  SDL_SetAtomicU32(&ring->markWrite, markWrite + 1);
+
+  SDL_SetAtomicU32(&ring->writeIndex, write + size);
+  return true;
+}
+
+void pcm_ring_discard(PcmRing *ring) {
+  SDL_SetAtomicU32(&ring->discardIndex, SDL_GetAtomicU32(&ring->writeIndex));
+}
+
+void pcm_ring_wait(PcmRing *ring, Sint32 timeoutMS) {
+  SDL_WaitSemaphoreTimeout(ring->space, timeoutMS);
+}
+
+void pcm_ring_wake(PcmRing *ring) { SDL_SignalSemaphore(ring->space); }
+
+// consumer: moves the read position and drops the marks of finished chunks
+static void advance_read(PcmRing *ring, Uint32 read) {
+  Uint32 markRead = SDL_GetAtomicU32(&ring->markRead);
+  Uint32 markWrite = SDL_GetAtomicU32(&ring->markWrite);
+  while (markRead != markWrite &&
+         (Sint32)(ring->marks[markRead % PCM_RING_MARKS].end - read) <= 0) {
+    markRead++;
+  }
+  SDL_SetAtomicU32(&ring->markRead, markRead);
+  SDL_SetAtomicU32(&ring->readIndex, read);
+}
+
+int pcm_ring_peek(PcmRing *ring, uint8_t **data, int max, double *endPts,
+                  int *serial) {
+  Uint32 read = SDL_GetAtomicU32(&ring->readIndex);
+
+  // samples of the old position, skipped without ever being played
+  Uint32 discard = SDL_GetAtomicU32(&ring->discardIndex);
+  if ((Sint32)(discard - read) > 0) {
+    read = discard;
+    advance_read(ring, read);
+    SDL_SignalSemaphore(ring->space);
+  }
+
+  Uint32 available = SDL_GetAtomicU32(&ring->writeIndex) - read;
+  if (available == 0 || max <= 0) {
+    return 0;
+  }
+
+  // the chunk of the oldest mark, up to the end of the buffer
+  PcmMark *mark =
+      &ring->marks[SDL_GetAtomicU32(&ring->markRead) % PCM_RING_MARKS];
+  Uint32 offset = read & (ring->capacity - 1);
+  Uint32 size = SDL_min(available, (Uint32)max);
+  size = SDL_min(size, mark->end - read);
+  size = SDL_min(size, ring->capacity - offset);
+
+  *data = ring->data + offset;
+  *endPts = mark->endPts -
+            (double)(mark->end - (read + size)) / ring->bytesPerSecond;
+  *serial = mark->serial;
+  return (int)size;
+}
+
+void pcm_ring_consume(PcmRing *ring, int size) {
+  advance_read(ring, SDL_GetAtomicU32(&ring->readIndex) + size);
+  SDL_SignalSemaphore(ring->space);
+}
@@ -0,0 +1,101 @@
+#include "playbackClock.h"
+
+void playback_clock_init(PlaybackClock *clock, SDL_AudioStream *stream,
+                         int sampleRate, int channels, int bytesPerSample) {
+  clock->lock = 0;
+  clock->stream = stream;
+  clock->bytesPerSecond = sampleRate * channels * bytesPerSample;
+
+  // samples the device pulled out of the stream but didn't play yet
+  clock->latency = 0.0;
+  SDL_AudioSpec spec;
+  int sampleFrames = 0;
+  SDL_AudioDeviceID device = SDL_GetAudioStreamDevice(stream);
+  if (device && SDL_GetAudioDeviceFormat(device, &spec, &sampleFrames) &&
+      spec.freq > 0) {
+    clock->latency = (double)sampleFrames / spec.freq;
+  }
+
+  clock->paused = false;
+  playback_clock_reset(clock);
+}
+
+bool playback_clock_queue(PlaybackClock *clock, const void *data, int size,
+                          double endPts, int serial) {
+
+  // only the callback writes the serial, it can read it without the lock.
+  // Samples of the old position are still queued after a seek.
+  if (serial != clock->serial && clock->serial >= 0) {
+    SDL_ClearAudioStream(clock->stream);
+  }
+
+  if (!SDL_PutAudioStreamData(clock->stream, data, size)) {
+    return false;
+  }
+  int queued = SDL_GetAudioStreamQueued(clock->stream);
+  Uint64 now = SDL_GetTicksNS();
+
+  SDL_LockSpinlock(&clock->lock);
+  clock->pts = endPts - (double)SDL_max(queued, 0) / clock->bytesPerSecond -
+               clock->latency;
+  clock->ticks = now;
+  clock->serial = serial;
+  SDL_UnlockSpinlock(&clock->lock);
+
+  return true;
+}
+
+void playback_clock_reset(PlaybackClock *clock) {
+  SDL_LockSpinlock(&clock->lock);
+  clock->pts = 0.0;
+  clock->ticks = 0;
+  clock->serial = -1;
+  SDL_UnlockSpinlock(&clock->lock);
+}
+
+// the position moves with the wall clock since the last stamp, but never
+// further than one device buffer
+static double extrapolate(PlaybackClock *clock, Uint64 now) {
+  double maxElapsed = clock->latency > 0.0 ? clock->latency : 0.05;
+  double elapsed = now > clock->ticks ? (double)(now - clock->ticks) / 1e9 : 0;
+  return clock->pts + SDL_min(elapsed, maxElapsed);
+}
+
+void playback_clock_set_paused(PlaybackClock *clock, bool paused) {
+  Uint64 now = SDL_GetTicksNS();
+
+  SDL_LockSpinlock(&clock->lock);
+  if (paused && !clock->paused && clock->serial >= 0) {
+    // the callback stops, the position stays where it was paused
+    clock->pts = extrapolate(clock, now);
+  }
+  clock->ticks = now;
+  clock->paused = paused;
+  SDL_UnlockSpinlock(&clock->lock);
+}
+
+bool playback_clock_peek(PlaybackClock *clock, int serial, double *position) {
+  SDL_LockSpinlock(&clock->lock);
+  bool valid = clock->serial == serial && clock->serial >= 0;
+  double pts = clock->pts;
+  SDL_UnlockSpinlock(&clock->lock);
+
+  if (valid) {
+    *position = pts;
+  }
+  return valid;
+}
+
+bool playback_clock_get(PlaybackClock *clock, int serial, double *position) {
+  Uint64 now = SDL_GetTicksNS();
+
+  SDL_LockSpinlock(&clock->lock);
+  bool valid = clock->serial == serial && clock->serial >= 0;
+  double pts = clock->paused ? clock->pts : extrapolate(clock, now);
+  SDL_UnlockSpinlock(&clock->lock);
+
+  if (valid) {
+    *position = pts;
+  }
+  return valid;
+}
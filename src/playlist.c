@@ -0,0 +1,245 @@
+#include "playlist.h"
+
+// the same files the file dialog offers
+static const char *video_extensions[] = {"mp4", "mkv", "avi",
+                                         "mov", "webm", "flv"};
+
+PreparedMedia *media_prepare(const char *path, PlaybackClock *clock,
+                             bool loop) {
+  PreparedMedia *media = (PreparedMedia *)calloc(1, sizeof(PreparedMedia));
+  if (!media) {
+    SDL_Log("PreparedMedia - Memory allocation error.");
+    return NULL;
+  }
+
+  Uint64 start = SDL_GetTicksNS();
+  media->path = SDL_strdup(path);
+  media->demuxer = demuxer_open(path);
+  if (!media->path || !media->demuxer) {
+    SDL_Log("Failed to open %s.", path);
+    media_prepared_free(media);
+    return NULL;
+  }
+
+  Uint64 opened = SDL_GetTicksNS();
+
+  media->video = init_video_container(media->demuxer, false);
+  media->audio = init_audio_container(media->demuxer);
+  if (!media->video || !media->audio) {
+    SDL_Log("Failed to initialize the decoders of %s.", path);
+    media_prepared_free(media);
+    return NULL;
+  }
+
+  media->videoDecoder = video_decoder_create(media->video, clock);
+  if (!media->videoDecoder) {
+    media_prepared_free(media);
+    return NULL;
+  }
+
+  // packets are read ahead from now on, the first frame is decoded from
+  // them
+  Uint64 decoders = SDL_GetTicksNS();
+  media->demuxer->loop = loop;
+  if (!demuxer_start(media->demuxer)) {
+    media_prepared_free(media);
+    return NULL;
+  }
+  video_decoder_prime(media->videoDecoder);
+
+  Uint64 end = SDL_GetTicksNS();
+  SDL_Log("Prepared %s in %.1f ms (open + probe %.1f ms, decoders %.1f ms, "
+          "first frame %.1f ms).",
+          path, (double)(end - start) / 1e6, (double)(opened - start) / 1e6,
+          (double)(decoders - opened) / 1e6, (double)(end - decoders) / 1e6);
+  return media;
+}
+
+void media_prepared_take(PreparedMedia *media, Demuxer **demuxer,
+                         VideoContainer **video, VideoDecoder **videoDecoder,
+                         AudioContainer **audio) {
+  *demuxer = media->demuxer;
+  *video = media->video;
+  *videoDecoder = media->videoDecoder;
+  *audio = media->audio;
+  media->demuxer = NULL;
+  media->video = NULL;
+  media->videoDecoder = NULL;
+  media->audio = NULL;
+  media_prepared_free(media);
+}
+
+void media_prepared_free(PreparedMedia *media) {
+  if (!media) {
+    return;
+  }
+
+  demuxer_abort(media->demuxer);
+  video_decoder_destroy(media->videoDecoder);
+  free_video_data(media->video);
+  free_audio_data(media->audio);
+  demuxer_close(media->demuxer);
+  SDL_free(media->path);
+  free(media);
+}
+
+void playlist_init(Playlist *playlist, PlaybackClock *clock) {
+  memset(playlist, 0, sizeof(Playlist));
+  playlist->clock = clock;
+  playlist->prefetchIndex = -1;
+}
+
+static bool is_video_file(const char *path) {
+  const char *dot = SDL_strrchr(path, '.');
+  if (!dot) {
+    return false;
+  }
+  for (size_t i = 0; i < SDL_arraysize(video_extensions); i++) {
+    if (SDL_strcasecmp(dot + 1, video_extensions[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool playlist_append(Playlist *playlist, const char *path) {
+  if (playlist->count == playlist->capacity) {
+    int capacity = playlist->capacity ? playlist->capacity * 2 : 16;
+    char **grown =
+        (char **)realloc(playlist->paths, capacity * sizeof(char *));
+    if (!grown) {
+      return false;
+    }
+    playlist->paths = grown;
+    playlist->capacity = capacity;
+  }
+
+  playlist->paths[playlist->count] = SDL_strdup(path);
+  if (!playlist->paths[playlist->count]) {
+    return false;
+  }
+  playlist->count++;
+  return true;
+}
+
+static int compare_names(const void *a, const void *b) {
+  return SDL_strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+bool playlist_add(Playlist *playlist, const char *path) {
+  SDL_PathInfo info;
+  if (!SDL_GetPathInfo(path, &info)) {
+    SDL_Log("%s does not exist.", path);
+    return false;
+  }
+  if (info.type != SDL_PATHTYPE_DIRECTORY) {
+    return playlist_append(playlist, path);
+  }
+
+  int count = 0;
+  char **names = SDL_GlobDirectory(path, NULL, 0, &count);
+  if (!names) {
+    SDL_Log("Could not read %s: %s", path, SDL_GetError());
+    return false;
+  }
+  SDL_qsort(names, count, sizeof(char *), compare_names);
+
+  bool added = false;
+  char file[PATH_MAX];
+  for (int i = 0; i < count; i++) {
+    if (!is_video_file(names[i])) {
+      continue;
+    }
+    const char *separator = path[strlen(path) - 1] == '/' ? "" : "/";
+    snprintf(file, sizeof(file), "%s%s%s", path, separator, names[i]);
+    added = playlist_append(playlist, file) || added;
+  }
+  SDL_free(names);
+
+  if (!added) {
+    SDL_Log("No videos inside %s.", path);
+  }
+  return added;
+}
+
+bool playlist_is_active(Playlist *playlist) { return playlist->count > 1; }
+
+PreparedMedia *playlist_open_current(Playlist *playlist) {
+  return media_prepare(playlist->paths[playlist->current], playlist->clock,
+                       !playlist_is_active(playlist));
+}
+
+static int prefetch_thread_func(void *data) {
+  Playlist *playlist = (Playlist *)data;
+
+  // the current file is playing, it comes first
+  SDL_SetCurrentThreadPriority(SDL_THREAD_PRIORITY_LOW);
+  playlist->prefetched = media_prepare(
+      playlist->paths[playlist->prefetchIndex], playlist->clock, false);
+  return 0;
+}
+
+// waits for the prefetch thread, the prepared file (or NULL) stays in
+// prefetched
+static void playlist_join_prefetch(Playlist *playlist) {
+  if (playlist->prefetchThread) {
+    SDL_WaitThread(playlist->prefetchThread, NULL);
+    playlist->prefetchThread = NULL;
+  }
+}
+
+void playlist_prefetch(Playlist *playlist) {
+  if (!playlist_is_active(playlist)) {
+    return;
+  }
+
+  playlist_join_prefetch(playlist);
+  media_prepared_free(playlist->prefetched);
+  playlist->prefetched = NULL;
+
+  playlist->prefetchIndex = (playlist->current + 1) % playlist->count;
+  playlist->prefetchThread =
+      SDL_CreateThread(prefetch_thread_func, "PrefetchThread", playlist);
+  if (!playlist->prefetchThread) {
+    SDL_Log("Failed to create prefetch thread: %s", SDL_GetError());
+  }
+}
+
+PreparedMedia *playlist_next(Playlist *playlist, int step) {
+  if (playlist->count == 0) {
+    return NULL;
+  }
+
+  playlist_join_prefetch(playlist);
+
+  // files that can't be played are skipped, each one is tried once
+  for (int tries = 0; tries < playlist->count; tries++) {
+    playlist->current =
+        ((playlist->current + step) % playlist->count + playlist->count) %
+        playlist->count;
+
+    PreparedMedia *media = NULL;
+    if (playlist->prefetched && playlist->prefetchIndex == playlist->current) {
+      media = playlist->prefetched;
+      playlist->prefetched = NULL;
+    } else {
+      media = playlist_open_current(playlist);
+    }
+    if (media) {
+      return media;
+    }
+    step = step < 0 ? -1 : 1;
+  }
+  return NULL;
+}
+
+void playlist_destroy(Playlist *playlist) {
+  playlist_join_prefetch(playlist);
+  media_prepared_free(playlist->prefetched);
+
+  for (int i = 0; i < playlist->count; i++) {
+    SDL_free(playlist->paths[i]);
+  }
+  free(playlist->paths);
+  memset(playlist, 0, sizeof(Playlist));
+}
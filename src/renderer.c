@@ -1,6 +1,410 @@
 #include "renderer.h"
 
-void initRenderer(Renderer *renderer, int texWidth, int texHeight) {
+#include "shaderSources.h"
+
+static void setPlane(TexturePlane *plane, int width, int height,
+                     int bytesPerPixel, GLint internalFormat, GLenum format) {
+  plane->width = width;
+  plane->height = height;
+  plane->bytesPerPixel = bytesPerPixel;
+  plane->internalFormat = internalFormat;
+  plane->format = format;
+  plane->type = GL_UNSIGNED_BYTE;
+}
+
+// 10-bit samples in 16 bits each, normalized textures. The shader scales
+// them to 0..1, their position inside the 16 bits depends on the format.
+static void setPlane16(TexturePlane *plane, int width, int height,
+                       int components) {
+  setPlane(plane, width, height, 2 * components,
+           components == 2 ? GL_RG16 : GL_R16,
+           components == 2 ? GL_RG : GL_RED);
+  plane->type = GL_UNSIGNED_SHORT;
+}
+
+// describes the textures needed for the given upload format
+static void setupPlanes(Renderer *renderer, int texWidth, int texHeight,
+                        enum AVPixelFormat format) {
+
+  // 4:2:0, chroma planes have half the width and height (rounded up)
+  int chromaWidth = (texWidth + 1) / 2;
+  int chromaHeight = (texHeight + 1) / 2;
+
+  renderer->bitDepth = 8;
+  switch (format) {
+  case AV_PIX_FMT_YUV420P10:
+    renderer->planeCount = 3;
+    renderer->bitDepth = 10;
+    setPlane16(&renderer->planes[0], texWidth, texHeight, 1);
+    setPlane16(&renderer->planes[1], chromaWidth, chromaHeight, 1);
+    setPlane16(&renderer->planes[2], chromaWidth, chromaHeight, 1);
+    break;
+  case AV_PIX_FMT_P010:
+    renderer->planeCount = 2;
+    renderer->bitDepth = 10;
+    setPlane16(&renderer->planes[0], texWidth, texHeight, 1);
+    setPlane16(&renderer->planes[1], chromaWidth, chromaHeight, 2);
+    break;
+  case AV_PIX_FMT_YUV420P:
+  case AV_PIX_FMT_YUVJ420P:
+    renderer->planeCount = 3;
+    setPlane(&renderer->planes[0], texWidth, texHeight, 1, GL_R8, GL_RED);
+    setPlane(&renderer->planes[1], chromaWidth, chromaHeight, 1, GL_R8, GL_RED);
+    setPlane(&renderer->planes[2], chromaWidth, chromaHeight, 1, GL_R8, GL_RED);
+    break;
+  case AV_PIX_FMT_YUV444P:
+  case AV_PIX_FMT_YUVJ444P:
+    // 4:4:4, three full size planes
+    renderer->planeCount = 3;
+    for (int i = 0; i < 3; i++) {
+      setPlane(&renderer->planes[i], texWidth, texHeight, 1, GL_R8, GL_RED);
+    }
+    break;
+  case AV_PIX_FMT_NV12:
+    renderer->planeCount = 2;
+    setPlane(&renderer->planes[0], texWidth, texHeight, 1, GL_R8, GL_RED);
+    setPlane(&renderer->planes[1], chromaWidth, chromaHeight, 2, GL_RG8, GL_RG);
+    break;
+  default:
+    // RGB24, 3 because of RGB Values
+    renderer->planeCount = 1;
+    setPlane(&renderer->planes[0], texWidth, texHeight, 3, GL_RGB, GL_RGB);
+    break;
+  }
+
+  // all planes after each other inside one PBO
+  renderer->frameSize = 0;
+  for (int i = 0; i < renderer->planeCount; i++) {
+    TexturePlane *plane = &renderer->planes[i];
+    plane->offset = renderer->frameSize;
+    renderer->frameSize +=
+        (size_t)plane->width * plane->height * plane->bytesPerPixel;
+  }
+}
+
+// uploads all planes into the textures. With a bound PBO, data contains the
+// offsets inside the PBO instead of pointers.
+static void uploadPlanes(Renderer *renderer, uint8_t *const *data,
+                         const int *linesize) {
+
+  Uint64 traceStart = trace_now();
+  for (int i = 0; i < renderer->planeCount; i++) {
+    TexturePlane *plane = &renderer->planes[i];
+
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D, plane->texture);
+
+    // the rows of decoded frames are usually padded
+    if (linesize[i] % plane->bytesPerPixel == 0) {
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, linesize[i] / plane->bytesPerPixel);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, plane->width, plane->height,
+                      plane->format, plane->type, data[i]);
+      continue;
+    }
+
+    // padding that is no whole pixel (RGB24 rows of 3008 bytes). The row
+    // length can't express it, the unpack alignment can if the rows are only
+    // padded to it.
+    int rowBytes = plane->width * plane->bytesPerPixel;
+    int alignment = 8;
+    while (alignment > 1 &&
+           ((rowBytes + alignment - 1) & ~(alignment - 1)) != linesize[i]) {
+      alignment /= 2;
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (((rowBytes + alignment - 1) & ~(alignment - 1)) == linesize[i]) {
+      glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, plane->width, plane->height,
+                      plane->format, plane->type, data[i]);
+    } else {
+      // otherwise row by row, slow but right
+      for (int y = 0; y < plane->height; y++) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, plane->width, 1,
+                        plane->format, plane->type,
+                        data[i] + (size_t)y * linesize[i]);
+      }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  }
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glActiveTexture(GL_TEXTURE0);
+  trace_event("glTexSubImage2D", traceStart);
+}
+
+/**
+ * Sets the Y'CbCr to RGB matrix for the colorspace and range of the frame.
+ * BT.601, BT.709 and BT.2020 only differ in the luma coefficients Kr and Kb.
+ * Limited range ("MPEG", Y 16-235, C 16-240) is expanded to full range by
+ * scaling the matrix, so the shader only does one multiply-add.
+ */
+static void updateColorMatrix(Renderer *renderer, const AVFrame *frame) {
+
+  // RGB frames don't need a matrix
+  if (renderer->planeCount == 1) {
+    return;
+  }
+
+  int colorspace = frame->colorspace;
+  int colorRange = frame->color_range;
+  if (colorspace == renderer->colorspace &&
+      colorRange == renderer->colorRange) {
+    return;
+  }
+  renderer->colorspace = colorspace;
+  renderer->colorRange = colorRange;
+
+  float kr, kb;
+  switch (colorspace) {
+  case AVCOL_SPC_BT709:
+    kr = 0.2126f;
+    kb = 0.0722f;
+    break;
+  case AVCOL_SPC_BT2020_NCL:
+  case AVCOL_SPC_BT2020_CL:
+    kr = 0.2627f;
+    kb = 0.0593f;
+    break;
+  case AVCOL_SPC_BT470BG:
+  case AVCOL_SPC_SMPTE170M:
+    kr = 0.299f;
+    kb = 0.114f;
+    break;
+  default:
+    // not specified, HD videos are BT.709 nearly always, SD videos BT.601
+    if (renderer->planes[0].height >= 720) {
+      kr = 0.2126f;
+      kb = 0.0722f;
+    } else {
+      kr = 0.299f;
+      kb = 0.114f;
+    }
+    break;
+  }
+  float kg = 1.0f - kr - kb;
+
+  bool fullRange = colorRange == AVCOL_RANGE_JPEG ||
+                   renderer->format == AV_PIX_FMT_YUVJ420P ||
+                   renderer->format == AV_PIX_FMT_YUVJ444P;
+  // the levels scale with the bit depth, 16 of 255 is 64 of 1023
+  float maxValue = (float)((1 << renderer->bitDepth) - 1);
+  float step = (float)(1 << (renderer->bitDepth - 8));
+  float yScale = fullRange ? 1.0f : maxValue / (219.0f * step);
+  float cScale = fullRange ? 1.0f : maxValue / (224.0f * step);
+  float yOffset = fullRange ? 0.0f : 16.0f * step / maxValue;
+  float cOffset = 128.0f * step / maxValue;
+
+  // column major, one column for Y, Cb and Cr
+  // clang-format off
+  float matrix[9] = {
+      yScale,                     yScale,                                yScale,
+      0.0f,                       -cScale * 2.0f * kb * (1.0f - kb) / kg, cScale * 2.0f * (1.0f - kb),
+      cScale * 2.0f * (1.0f - kr), -cScale * 2.0f * kr * (1.0f - kr) / kg, 0.0f
+  };
+  // clang-format on
+  float offset[3] = {yOffset, cOffset, cOffset};
+
+  glUseProgram(renderer->shader.ID);
+  glUniformMatrix3fv(glGetUniformLocation(renderer->shader.ID, "yuvMatrix"), 1,
+                     GL_FALSE, matrix);
+  glUniform3fv(glGetUniformLocation(renderer->shader.ID, "yuvOffset"), 1,
+               offset);
+}
+
+// creates one buffer for all ring slots and maps it for the whole lifetime
+// of the renderer. Coherent, so written data needs no explicit flush.
+static bool initPersistentRing(Renderer *renderer) {
+
+  // texture uploads from a PBO want aligned offsets
+  renderer->ringSlotSize = (renderer->frameSize + 255) & ~(size_t)255;
+  GLsizeiptr ringSize =
+      (GLsizeiptr)(renderer->ringSlotSize * renderer->config.pboDepth);
+  GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+  glGenBuffers(1, &renderer->ringBuffer);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer->ringBuffer);
+  glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringSize, NULL, flags);
+  renderer->ringPtr =
+      (uint8_t *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringSize, flags);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (!renderer->ringPtr) {
+    glDeleteBuffers(1, &renderer->ringBuffer);
+    renderer->ringBuffer = 0;
+    return false;
+  }
+
+  for (int i = 0; i < PBO_RING_MAX_DEPTH; i++) {
+    renderer->ringFences[i] = NULL;
+  }
+  renderer->ringIndex = 0;
+
+  return true;
+}
+
+// blocks until the GPU finished reading the slot. With a few slots this has
+// normally happened frames ago.
+static void waitForRingSlot(Renderer *renderer, int slot) {
+  GLsync fence = renderer->ringFences[slot];
+  if (!fence) {
+    return;
+  }
+
+  Uint64 traceStart = trace_now();
+  GLenum status;
+  do {
+    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+  } while (status == GL_TIMEOUT_EXPIRED);
+  trace_event("pbo fence wait", traceStart);
+
+  glDeleteSync(fence);
+  renderer->ringFences[slot] = NULL;
+}
+
+// copies all planes of the frame one after another into dst, without the row
+// padding
+static void copyPlanes(Renderer *renderer, uint8_t *dst, vFrame *videoFrame) {
+  Uint64 traceStart = trace_now();
+  for (int i = 0; i < renderer->planeCount; i++) {
+    TexturePlane *plane = &renderer->planes[i];
+    int rowBytes = plane->width * plane->bytesPerPixel;
+    av_image_copy_plane(dst + plane->offset, rowBytes,
+                        videoFrame->frameYUV->data[i],
+                        videoFrame->frameYUV->linesize[i], rowBytes,
+                        plane->height);
+  }
+  trace_event("pbo copy", traceStart);
+}
+
+// uploads the planes from the currently bound PBO, starting at base
+static void uploadPlanesFromPBO(Renderer *renderer, size_t base) {
+  uint8_t *offsets[3];
+  int linesizes[3];
+  for (int i = 0; i < renderer->planeCount; i++) {
+    offsets[i] = (uint8_t *)(base + renderer->planes[i].offset);
+    linesizes[i] = renderer->planes[i].width * renderer->planes[i].bytesPerPixel;
+  }
+  uploadPlanes(renderer, offsets, linesizes);
+}
+
+// one program per family of upload formats, shared by all renderers of the
+// GL context
+static ShaderVariants rendererShaders;
+static bool rendererShadersReady = false;
+
+// 10-bit formats, SAMPLE_SCALE brings the 16-bit texture values to 0..1 of
+// the 10 bits. P010 has them in the high bits, yuv420p10 in the low bits.
+#define P010_DEFINES                                                           \
+  "#define SEMI_PLANAR_YUV\n#define SAMPLE_SCALE (65535.0 / 65472.0)\n"        \
+  "#define DITHER\n"
+#define YUV420P10_DEFINES                                                      \
+  "#define PLANAR_YUV\n#define SAMPLE_SCALE (65535.0 / 1023.0)\n"              \
+  "#define DITHER\n"
+#define WITH_TONE_MAPPING(defines, toneMap)                                    \
+  ((toneMap) == TONE_MAP_PQ    ? defines "#define TRANSFER_PQ\n"               \
+   : (toneMap) == TONE_MAP_HLG ? defines "#define TRANSFER_HLG\n"              \
+                               : defines)
+
+// the fragment shader variant for an upload format, see fragmentShader.frag.
+// Only 10-bit video gets tone mapped.
+static const char *shaderDefines(enum AVPixelFormat format,
+                                 ToneMapping toneMap) {
+  switch (format) {
+  case AV_PIX_FMT_P010:
+    return WITH_TONE_MAPPING(P010_DEFINES, toneMap);
+  case AV_PIX_FMT_YUV420P10:
+    return WITH_TONE_MAPPING(YUV420P10_DEFINES, toneMap);
+  case AV_PIX_FMT_YUV420P:
+  case AV_PIX_FMT_YUVJ420P:
+  case AV_PIX_FMT_YUV444P:
+  case AV_PIX_FMT_YUVJ444P:
+    return "#define PLANAR_YUV\n";
+  case AV_PIX_FMT_NV12:
+    return "#define SEMI_PLANAR_YUV\n";
+  default:
+    return "#define PACKED_RGB\n";
+  }
+}
+
+static ShaderVariants *getRendererShaders(void) {
+  if (!rendererShadersReady) {
+    initShaderVariants(&rendererShaders, vertexShaderSource,
+                       fragmentShaderSource);
+    rendererShadersReady = true;
+  }
+  return &rendererShaders;
+}
+
+void preloadRendererShader(void) {
+  // nearly every video is uploaded as one of these, software decoded
+  // yuv420p or nv12 from the hardware decoder. The rest is compiled when a
+  // video needs it.
+  getShaderVariant(getRendererShaders(),
+                   shaderDefines(AV_PIX_FMT_YUV420P, TONE_MAP_NONE));
+  getShaderVariant(getRendererShaders(),
+                   shaderDefines(AV_PIX_FMT_NV12, TONE_MAP_NONE));
+}
+
+void releaseRendererShaders(void) {
+  if (rendererShadersReady) {
+    deleteShaderVariants(&rendererShaders);
+    rendererShadersReady = false;
+  }
+}
+
+// switches to the variant for the format of the renderer and toneMap. The
+// uniforms are per program, they are set again.
+static bool useShaderVariant(Renderer *renderer, ToneMapping toneMap) {
+  const Shader *shader = getShaderVariant(
+      getRendererShaders(), shaderDefines(renderer->format, toneMap));
+  // stays with the program it has, it's not tried again for every frame
+  renderer->toneMap = toneMap;
+  if (!shader) {
+    SDL_Log("Shader variant failed, keeping the previous one.");
+    return false;
+  }
+  renderer->shader = *shader;
+
+  // texture units of the planes, variants without them ignore the -1
+  // locations
+  useShader(&renderer->shader);
+  glUniform1i(glGetUniformLocation(renderer->shader.ID, "videoTexture"), 0);
+  glUniform1i(glGetUniformLocation(renderer->shader.ID, "planeU"), 1);
+  glUniform1i(glGetUniformLocation(renderer->shader.ID, "planeV"), 2);
+  glUniformMatrix4fv(glGetUniformLocation(renderer->shader.ID, "transform"), 1,
+                     GL_FALSE, renderer->transform);
+
+  // the color matrix goes to the new program with the next frame
+  renderer->colorspace = -1;
+  renderer->colorRange = -1;
+  return true;
+}
+
+// HDR frames get the variant that tone maps them to SDR. A video changes its
+// transfer function rarely, if at all, so this is a compare per frame.
+static void updateToneMapping(Renderer *renderer, const AVFrame *frame) {
+  ToneMapping toneMap = TONE_MAP_NONE;
+  if (renderer->bitDepth > 8 && renderer->config.toneMapping) {
+    if (frame->color_trc == AVCOL_TRC_SMPTE2084) {
+      toneMap = TONE_MAP_PQ;
+    } else if (frame->color_trc == AVCOL_TRC_ARIB_STD_B67) {
+      toneMap = TONE_MAP_HLG;
+    }
+  }
+  if (toneMap != renderer->toneMap) {
+    useShaderVariant(renderer, toneMap);
+  }
+}
+
+// the shader state a frame needs before it's drawn
+static void updateColorState(Renderer *renderer, const AVFrame *frame) {
+  updateToneMapping(renderer, frame);
+  updateColorMatrix(renderer, frame);
+}
+
+void initRenderer(Renderer *renderer, int texWidth, int texHeight,
+                  enum AVPixelFormat format, const RendererConfig *config) {
 
   SDL_GL_SetSwapInterval(1);
 
@@ -22,13 +426,42 @@ void initRenderer(Renderer *renderer, int texWidth, int texHeight) {
   glGenVertexArrays(1, &renderer->vao);
   glGenBuffers(1, &renderer->vbo);
   glGenBuffers(1, &renderer->ebo);
-  glGenQueries(1, &renderer->queryID);
+  initGpuTimer(&renderer->gpuTimer);
+
+  renderer->format = format;
+  renderer->colorspace = -1;
+  renderer->colorRange = -1;
+  setupPlanes(renderer, texWidth, texHeight, format);
+
+  if (config) {
+    renderer->config = *config;
+  } else {
+    renderer->config.uploadMode = UPLOAD_PERSISTENT_PBO;
+    renderer->config.pboDepth = PBO_RING_DEFAULT_DEPTH;
+    renderer->config.toneMapping = true;
+  }
+  if (renderer->config.pboDepth < PBO_RING_MIN_DEPTH) {
+    renderer->config.pboDepth = PBO_RING_MIN_DEPTH;
+  } else if (renderer->config.pboDepth > PBO_RING_MAX_DEPTH) {
+    renderer->config.pboDepth = PBO_RING_MAX_DEPTH;
+  }
+
+  renderer->ringBuffer = 0;
+  renderer->ringPtr = NULL;
+  if (renderer->config.uploadMode == UPLOAD_PERSISTENT_PBO) {
+    if (!GLExt.bufferStorage || !initPersistentRing(renderer)) {
+      SDL_Log("Persistent mapped PBOs not available, using two PBOs.");
+      renderer->config.uploadMode = UPLOAD_PBO;
+    }
+  }
 
   glGenBuffers(2, renderer->pbo);
-  for (int i = 0; i < 2; i++) {
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer->pbo[i]);
-    glBufferData(GL_PIXEL_UNPACK_BUFFER, texWidth * texHeight * 3, NULL,
-                 GL_STREAM_DRAW); // 3 because of RGB Values
+  if (renderer->config.uploadMode == UPLOAD_PBO) {
+    for (int i = 0; i < 2; i++) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer->pbo[i]);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, renderer->frameSize, NULL,
+                   GL_STREAM_DRAW);
+    }
   }
 
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
@@ -61,75 +494,256 @@ void initRenderer(Renderer *renderer, int texWidth, int texHeight) {
   // unbined the vao
   glBindVertexArray(0);
 
-  // generates a texture ID for OpenGL
-  glGenTextures(1, &renderer->texture);
-
-  // activates the texture and setting up all attribs for this texture
-  glBindTexture(GL_TEXTURE_2D, renderer->texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texWidth, texHeight, 0, GL_RGB,
-               GL_UNSIGNED_BYTE, NULL);
-
-  renderer->shader = createShader("../shader/vertexShader.vert",
-                                  "../shader/fragmentShader.frag");
+  // rows of odd width planes are not 4 byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  // generates one texture ID per plane. Texture unit i always holds plane i.
+  for (int i = 0; i < renderer->planeCount; i++) {
+    TexturePlane *plane = &renderer->planes[i];
+    glGenTextures(1, &plane->texture);
+
+    // activates the texture and setting up all attribs for this texture
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D, plane->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, plane->internalFormat, plane->width,
+                 plane->height, 0, plane->format, plane->type, NULL);
+  }
+  glActiveTexture(GL_TEXTURE0);
+
+  // the variant for this format, compiled on its first use. HDR frames
+  // switch to their tone mapping variant when they come.
+  static const float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+                                     0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+                                     0.0f, 0.0f, 0.0f, 1.0f};
+  memcpy(renderer->transform, identity, sizeof(identity));
+  renderer->shader.ID = 0;
+  renderer->toneMap = TONE_MAP_NONE;
+  useShaderVariant(renderer, TONE_MAP_NONE);
 }
 
-// renders a texture-frame in sync with the CPU/GPU
-void renderFrame(Renderer *renderer, unsigned int srcWidth,
-                 unsigned int srcHeight, vFrame *videoFrame) {
-
-  // glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-  // glClear(GL_COLOR_BUFFER_BIT);
-
-  // frameYUV->data uses RGB not YUV from the frames
-  glBindTexture(GL_TEXTURE_2D, renderer->texture);
+// uploads a texture-frame in sync with the CPU/GPU
+static void uploadFrame(Renderer *renderer, vFrame *videoFrame) {
 
-  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, srcWidth, srcHeight, GL_RGB,
-                  GL_UNSIGNED_BYTE, videoFrame->frameYUV->data[0]);
-
-  useShader(&renderer->shader);
-  glBindVertexArray(renderer->vao);
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+  // frameYUV holds RGB or the native YUV planes of the frame
+  beginGpuTimer(&renderer->gpuTimer, GPU_STAGE_UPLOAD);
+  uploadPlanes(renderer, videoFrame->frameYUV->data,
+               videoFrame->frameYUV->linesize);
+  endGpuTimer(&renderer->gpuTimer, GPU_STAGE_UPLOAD);
+  updateColorState(renderer, videoFrame->frame);
 }
-// renders a texture-frame in async with the CPU/GPU
-void renderFrameWithPBO(Renderer *renderer, unsigned int srcWidth,
-                        unsigned int srcHeight, vFrame *videoFrame) {
+
+// uploads a texture-frame in async with the CPU/GPU
+static void uploadFrameWithPBO(Renderer *renderer, vFrame *videoFrame) {
 
   int nextPboIndex = (renderer->pboIndex + 1) % 2; // Change between PBO 0 and 1
 
   // Bind the pbo with data (Cpu fills data)
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer->pbo[nextPboIndex]);
-  glBufferData(GL_PIXEL_UNPACK_BUFFER, srcWidth * srcHeight * 3, NULL,
+  Uint64 traceStart = trace_now();
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, renderer->frameSize, NULL,
                GL_STREAM_DRAW); // reserve data
-  void *ptr =
-      glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY); // access to buffer
+  uint8_t *ptr = (uint8_t *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER,
+                                        GL_WRITE_ONLY); // access to buffer
+  trace_event("pbo map", traceStart);
   if (ptr) {
-    memcpy(ptr, videoFrame->frameYUV->data[0],
-           srcWidth * srcHeight * 3); // copy data
+    // copy data, plane by plane without the row padding
+    copyPlanes(renderer, ptr, videoFrame);
     glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
   }
   // Bind the old PBO for uploading data to the GPU
-  glBindTexture(GL_TEXTURE_2D, renderer->texture);
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer->pbo[renderer->pboIndex]);
 
-  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, srcWidth, srcHeight, GL_RGB,
-                  GL_UNSIGNED_BYTE, 0);
+  beginGpuTimer(&renderer->gpuTimer, GPU_STAGE_UPLOAD);
+  uploadPlanesFromPBO(renderer, 0);
+  endGpuTimer(&renderer->gpuTimer, GPU_STAGE_UPLOAD);
+  updateColorState(renderer, videoFrame->frame);
 
-  // unbind and render Frames
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-  useShader(&renderer->shader);
-  glBindVertexArray(renderer->vao);
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
   // switch PBO'S to use.
   renderer->pboIndex = nextPboIndex;
 }
+
+// uploads a texture-frame through the persistent mapped PBO ring. No
+// allocation and no mapping per frame, the fence of a slot is only waited on
+// when the ring comes around to it again.
+static void uploadFrameWithPersistentPBO(Renderer *renderer,
+                                         vFrame *videoFrame) {
+
+  // frames of an attached frame ring bring their own slot
+  int slot = videoFrame->uploadSlot;
+  if (slot < 0) {
+    slot = renderer->ringIndex;
+    renderer->ringIndex = (slot + 1) % renderer->config.pboDepth;
+  }
+  size_t base = (size_t)slot * renderer->ringSlotSize;
+
+  waitForRingSlot(renderer, slot);
+  if (videoFrame->uploadSlot < 0) {
+    copyPlanes(renderer, renderer->ringPtr + base, videoFrame);
+  }
+
+  // the upload from this slot is queued right away, there is no need to
+  // delay it by one frame like with the two PBOs
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer->ringBuffer);
+  beginGpuTimer(&renderer->gpuTimer, GPU_STAGE_UPLOAD);
+  uploadPlanesFromPBO(renderer, base);
+  endGpuTimer(&renderer->gpuTimer, GPU_STAGE_UPLOAD);
+  renderer->ringFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  updateColorState(renderer, videoFrame->frame);
+}
+
+// renders a texture-frame in sync with the CPU/GPU
+void renderFrame(Renderer *renderer, vFrame *videoFrame) {
+
+  // glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  // glClear(GL_COLOR_BUFFER_BIT);
+
+  uploadFrame(renderer, videoFrame);
+  renderFrameWithoutUpdate(renderer);
+}
+// renders a texture-frame in async with the CPU/GPU
+void renderFrameWithPBO(Renderer *renderer, vFrame *videoFrame) {
+  uploadFrameWithPBO(renderer, videoFrame);
+  renderFrameWithoutUpdate(renderer);
+}
+// renders a texture-frame through the persistent mapped PBO ring
+void renderFrameWithPersistentPBO(Renderer *renderer, vFrame *videoFrame) {
+  uploadFrameWithPersistentPBO(renderer, videoFrame);
+  renderFrameWithoutUpdate(renderer);
+}
+
+void uploadVideoFrame(Renderer *renderer, vFrame *videoFrame) {
+  switch (renderer->config.uploadMode) {
+  case UPLOAD_DIRECT:
+    uploadFrame(renderer, videoFrame);
+    break;
+  case UPLOAD_PBO:
+    uploadFrameWithPBO(renderer, videoFrame);
+    break;
+  case UPLOAD_PERSISTENT_PBO:
+    uploadFrameWithPersistentPBO(renderer, videoFrame);
+    break;
+  }
+}
+
+void renderVideoFrame(Renderer *renderer, vFrame *videoFrame) {
+  uploadVideoFrame(renderer, videoFrame);
+  renderFrameWithoutUpdate(renderer);
+}
+
+bool attachFrameRing(Renderer *renderer, FrameRing *ring) {
+
+  bool direct = renderer->config.uploadMode == UPLOAD_PERSISTENT_PBO &&
+                renderer->ringPtr &&
+                renderer->config.pboDepth >= FRAME_RING_SIZE;
+
+  // slots might still be read for the frames of the previous video
+  if (renderer->ringPtr) {
+    for (int i = 0; i < renderer->config.pboDepth; i++) {
+      waitForRingSlot(renderer, i);
+    }
+  }
+
+  for (int i = 0; i < FRAME_RING_SIZE; i++) {
+    vFrame *videoFrame = ring->slots[i];
+
+    videoFrame->uploadSlot = direct ? i : -1;
+    for (int p = 0; p < 4; p++) {
+      videoFrame->uploadData[p] = NULL;
+      videoFrame->uploadLinesize[p] = 0;
+    }
+    if (!direct) {
+      continue;
+    }
+
+    // same tight layout the render thread uses in copyPlanes
+    uint8_t *base = renderer->ringPtr + (size_t)i * renderer->ringSlotSize;
+    for (int p = 0; p < renderer->planeCount; p++) {
+      TexturePlane *plane = &renderer->planes[p];
+      videoFrame->uploadData[p] = base + plane->offset;
+      videoFrame->uploadLinesize[p] = plane->width * plane->bytesPerPixel;
+    }
+  }
+
+  if (!direct && renderer->config.uploadMode == UPLOAD_PERSISTENT_PBO) {
+    SDL_Log("PBO ring has less than %d slots, frames are copied by the "
+            "render thread.",
+            FRAME_RING_SIZE);
+  }
+
+  return direct;
+}
+
+void waitFrameUpload(Renderer *renderer, vFrame *videoFrame) {
+  if (videoFrame->uploadSlot >= 0) {
+    waitForRingSlot(renderer, videoFrame->uploadSlot);
+  }
+}
+
+bool isFrameInUse(Renderer *renderer, vFrame *videoFrame) {
+  if (videoFrame->uploadSlot < 0) {
+    return false;
+  }
+
+  GLsync fence = renderer->ringFences[videoFrame->uploadSlot];
+  if (!fence) {
+    return false;
+  }
+
+  // only asks, never waits
+  GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    return true;
+  }
+
+  glDeleteSync(fence);
+  renderer->ringFences[videoFrame->uploadSlot] = NULL;
+  return false;
+}
+
+bool parseUploadMode(const char *name, UploadMode *mode) {
+  if (strcmp(name, "tex") == 0) {
+    *mode = UPLOAD_DIRECT;
+  } else if (strcmp(name, "pbo") == 0) {
+    *mode = UPLOAD_PBO;
+  } else if (strcmp(name, "persistent") == 0) {
+    *mode = UPLOAD_PERSISTENT_PBO;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *uploadModeName(UploadMode mode) {
+  switch (mode) {
+  case UPLOAD_DIRECT:
+    return "tex";
+  case UPLOAD_PBO:
+    return "pbo";
+  case UPLOAD_PERSISTENT_PBO:
+    return "persistent";
+  }
+  return "unknown";
+}
+
 void renderFrameWithoutUpdate(Renderer *renderer) {
 
+  beginGpuTimer(&renderer->gpuTimer, GPU_STAGE_DRAW);
   useShader(&renderer->shader);
   glBindVertexArray(renderer->vao);
   glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+  endGpuTimer(&renderer->gpuTimer, GPU_STAGE_DRAW);
+
+  // every frame ends with a draw, results of earlier frames are picked up
+  // here once they are available
+  advanceGpuTimer(&renderer->gpuTimer);
 }
 
 void updateVideoTranformation(Renderer *renderer, int windowWidth,
@@ -165,28 +779,46 @@ void updateVideoTranformation(Renderer *renderer, int windowWidth,
   // clang-format on
 
   // use shader and set uniform varible "transform" from the vertex shader
+  memcpy(renderer->transform, transform, sizeof(transform));
   glUseProgram(renderer->shader.ID);
   int transformLoc = glGetUniformLocation(renderer->shader.ID, "transform");
   glUniformMatrix4fv(transformLoc, 1, GL_FALSE, transform);
 }
 
 void cleanupRenderer(Renderer *renderer) {
-  glDeleteQueries(1, &renderer->queryID);
+  cleanupGpuTimer(&renderer->gpuTimer);
   glDeleteVertexArrays(1, &renderer->vao);
   glDeleteBuffers(1, &renderer->vbo);
   glDeleteBuffers(1, &renderer->ebo);
-  glDeleteTextures(1, &renderer->texture);
-}
-
-void startTimerQuery(Renderer *renderer) {
-  glBeginQuery(GL_TIME_ELAPSED, renderer->queryID);
+  glDeleteBuffers(2, renderer->pbo);
+  if (renderer->ringBuffer) {
+    for (int i = 0; i < PBO_RING_MAX_DEPTH; i++) {
+      if (renderer->ringFences[i]) {
+        glDeleteSync(renderer->ringFences[i]);
+        renderer->ringFences[i] = NULL;
+      }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer->ringBuffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &renderer->ringBuffer);
+    renderer->ringBuffer = 0;
+    renderer->ringPtr = NULL;
+  }
+  for (int i = 0; i < renderer->planeCount; i++) {
+    glDeleteTextures(1, &renderer->planes[i].texture);
+  }
+  // the program stays with the variants, the next renderer reuses it
+  renderer->shader.ID = 0;
 }
 
-void endTimerQuery(Renderer *renderer) {
-  glEndQuery(GL_TIME_ELAPSED);
-
-  GLuint64 timeElapsed = 0;
-  glGetQueryObjectui64v(renderer->queryID, GL_QUERY_RESULT, &timeElapsed);
-
-  printf("Frame Render Time: %f ms\n", timeElapsed / 1e6);
+void printGpuTimes(Renderer *renderer) {
+  for (int i = 0; i < GPU_STAGE_COUNT; i++) {
+    GpuTimerStats stats;
+    getGpuTimerStats(&renderer->gpuTimer, (GpuTimerStage)i, &stats);
+    printf("GPU %s time over %d frames: p50 %.1f ms, p95 %.1f ms, p99 %.1f "
+           "ms, max %.2f ms (%d frames not measured)\n",
+           gpuTimerStageName((GpuTimerStage)i), stats.count, stats.p50Ms,
+           stats.p95Ms, stats.p99Ms, stats.maxMs, stats.skipped);
+  }
 }
\ No newline at end of file
@@ -0,0 +1,232 @@
+#include "seekIndex.h"
+
+#include <string.h>
+
+SeekIndex *seek_index_create(const char *path, int streamIndex,
+                             AVRational time_base) {
+  SeekIndex *index = (SeekIndex *)calloc(1, sizeof(SeekIndex));
+  if (!index) {
+    fprintf(stderr, "SeekIndex - Memory allocation error.\n");
+    return NULL;
+  }
+
+  index->path = SDL_strdup(path);
+  index->mutex = SDL_CreateMutex();
+  if (!index->path || !index->mutex) {
+    fprintf(stderr, "SeekIndex - Memory allocation error.\n");
+    seek_index_destroy(index);
+    return NULL;
+  }
+  index->streamIndex = streamIndex;
+  index->time_base = time_base;
+  SDL_SetAtomicInt(&index->complete, 0);
+
+  return index;
+}
+
+bool seek_index_adopt(SeekIndex *index, IndexCache *cache) {
+  if (cache->header->entrySize != sizeof(SeekIndexEntry) || index->thread) {
+    return false;
+  }
+
+  SDL_LockMutex(index->mutex);
+  free(index->entries);
+  // read-only mapping, a complete index never changes
+  index->entries = (SeekIndexEntry *)cache->entries;
+  index->count = (int)cache->header->count;
+  index->capacity = 0;
+  index->cache = cache;
+  SDL_UnlockMutex(index->mutex);
+
+  SDL_SetAtomicInt(&index->complete, 1);
+  return true;
+}
+
+void seek_index_set_cache_streams(SeekIndex *index,
+                                  const IndexCacheStreams *streams) {
+  index->streams = *streams;
+  index->saveCache = true;
+}
+
+bool seek_index_add(SeekIndex *index, const SeekIndexEntry *entry) {
+  if (index->cache) {
+    return false;
+  }
+
+  SDL_LockMutex(index->mutex);
+
+  if (index->count == index->capacity) {
+    int capacity = index->capacity ? index->capacity * 2 : 1024;
+    SeekIndexEntry *grown = (SeekIndexEntry *)realloc(
+        index->entries, capacity * sizeof(SeekIndexEntry));
+    if (!grown) {
+      SDL_UnlockMutex(index->mutex);
+      return false;
+    }
+    index->entries = grown;
+    index->capacity = capacity;
+  }
+
+  // packets come in file order, keyframes almost always in pts order too
+  int at = index->count;
+  while (at > 0 && index->entries[at - 1].pts > entry->pts) {
+    at--;
+  }
+  if (at > 0 && index->entries[at - 1].pts == entry->pts) {
+    SDL_UnlockMutex(index->mutex);
+    return true;
+  }
+  memmove(&index->entries[at + 1], &index->entries[at],
+          (index->count - at) * sizeof(SeekIndexEntry));
+  index->entries[at] = *entry;
+  index->count++;
+
+  SDL_UnlockMutex(index->mutex);
+  return true;
+}
+
+bool seek_index_lookup(SeekIndex *index, int64_t pts, SeekIndexEntry *entry) {
+  bool found = false;
+
+  SDL_LockMutex(index->mutex);
+
+  // a keyframe between the last entry and pts might not be scanned yet
+  bool covered = index->count > 0 &&
+                 (index->entries[index->count - 1].pts >= pts ||
+                  seek_index_is_complete(index));
+
+  if (covered) {
+    // binary search for the last entry <= pts
+    int low = 0;
+    int high = index->count - 1;
+    int best = -1;
+    while (low <= high) {
+      int mid = low + (high - low) / 2;
+      if (index->entries[mid].pts <= pts) {
+        best = mid;
+        low = mid + 1;
+      } else {
+        high = mid - 1;
+      }
+    }
+    if (best >= 0) {
+      *entry = index->entries[best];
+      found = true;
+    }
+  }
+
+  SDL_UnlockMutex(index->mutex);
+  return found;
+}
+
+bool seek_index_is_complete(SeekIndex *index) {
+  return SDL_GetAtomicInt(&index->complete) != 0;
+}
+
+static int seek_index_thread_func(void *data) {
+  SeekIndex *index = (SeekIndex *)data;
+
+  // playback always comes first
+  SDL_SetCurrentThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+  // no avformat_find_stream_info, only packets are read. The streams of
+  // most containers are known right after opening, if not the index is
+  // skipped.
+  AVFormatContext *pFormatCtx = NULL;
+  if (avformat_open_input(&pFormatCtx, index->path, NULL, NULL) != 0) {
+    fprintf(stderr, "SeekIndex - could not open file.\n");
+    return -1;
+  }
+  if (index->streamIndex >= (int)pFormatCtx->nb_streams ||
+      pFormatCtx->streams[index->streamIndex]->codecpar->codec_type !=
+          AVMEDIA_TYPE_VIDEO) {
+    fprintf(stderr, "SeekIndex - streams are unknown without probing, no "
+                    "index for this file.\n");
+    avformat_close_input(&pFormatCtx);
+    return -1;
+  }
+
+  // only keyframes of the video stream are needed, demuxers that support it
+  // skip the rest
+  for (unsigned int i = 0; i < pFormatCtx->nb_streams; i++) {
+    pFormatCtx->streams[i]->discard =
+        (int)i == index->streamIndex ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+  }
+  AVRational time_base = pFormatCtx->streams[index->streamIndex]->time_base;
+
+  AVPacket *packet = av_packet_alloc();
+  if (!packet) {
+    avformat_close_input(&pFormatCtx);
+    return -1;
+  }
+
+  while (index->running && av_read_frame(pFormatCtx, packet) >= 0) {
+    if (packet->stream_index == index->streamIndex &&
+        (packet->flags & AV_PKT_FLAG_KEY) && packet->pos >= 0) {
+      int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+      int64_t dts = packet->dts != AV_NOPTS_VALUE ? packet->dts : pts;
+      if (pts != AV_NOPTS_VALUE) {
+        SeekIndexEntry entry = {
+            av_rescale_q(pts, time_base, index->time_base),
+            av_rescale_q(dts, time_base, index->time_base), packet->pos,
+            packet->size};
+        seek_index_add(index, &entry);
+      }
+    }
+    av_packet_unref(packet);
+  }
+
+  if (index->running) {
+    SDL_SetAtomicInt(&index->complete, 1);
+    SDL_Log("Seek index complete, %d keyframes.", index->count);
+
+    // this thread is the only writer, the entries don't change anymore
+    if (index->saveCache && index->count > 0) {
+      index_cache_save(index->path, &index->streams, index->entries,
+                       index->count, sizeof(SeekIndexEntry));
+    }
+  }
+
+  av_packet_free(&packet);
+  avformat_close_input(&pFormatCtx);
+  return 0;
+}
+
+bool seek_index_start(SeekIndex *index) {
+  if (seek_index_is_complete(index)) {
+    return true;
+  }
+
+  index->running = true;
+  index->thread =
+      SDL_CreateThread(seek_index_thread_func, "SeekIndexThread", index);
+  if (!index->thread) {
+    SDL_Log("Failed to create seek index thread: %s", SDL_GetError());
+    index->running = false;
+    return false;
+  }
+  return true;
+}
+
+void seek_index_destroy(SeekIndex *index) {
+  if (!index) {
+    return;
+  }
+
+  index->running = false;
+  if (index->thread) {
+    SDL_WaitThread(index->thread, NULL);
+    index->thread = NULL;
+  }
+
+  if (index->mutex) {
+    SDL_DestroyMutex(index->mutex);
+  }
+  if (index->cache) {
+    index_cache_close(index->cache);
+  } else {
+    free(index->entries);
+  }
+  SDL_free(index->path);
+  free(index);
+}
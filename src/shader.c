@@ -1,112 +1,270 @@
 #include <shader.h>
 
-// intern function to read glsl shader files
-static char *readFile(const char *filePath) {
-  // open file
-  FILE *file = fopen(filePath, "r");
-  if (!file) {
-    printf("ERROR: Unable to open file %s\n", filePath);
-    return NULL;
-  }
-
-  // sets pointer in the file to the end of the file.s
-  fseek(file, 0, SEEK_END);
-
-  // gives back the size of the file based on the pointer position.
-  // here it is placed at the end of the file, so it gets the whole size.
-  long legth = ftell(file);
-
-  // sets pointer to the start again.
-  rewind(file);
-
-  char *buffer = (char *)malloc(legth + 1);
-
-  if (!buffer) {
-    printf("ERROR: Memory allocation failed, trying to reading a file...\n");
-    fclose(file);
-    return NULL;
-  }
+#include <limits.h>
+#include <string.h>
 
-  fread(buffer, 1, legth, file);
+#include "cacheDir.h"
+#include "glExtensions.h"
 
-  // adding the null character..
-  buffer[legth] = '\0';
+static const char PROGRAM_CACHE_MAGIC[4] = {'L', 'S', 'P', 'B'};
 
-  fclose(file);
-
-  return buffer;
-}
+// in front of every cached program binary
+typedef struct ProgramCacheHeader {
+  char magic[4]; // "LSPB"
+  uint32_t format; // binaryFormat of glGetProgramBinary
+  uint64_t key;    // programKey, guards against hash collisions of the name
+  uint32_t length;
+  uint32_t reserved;
+} ProgramCacheHeader;
 
 // checks for shader compilation errors
-static void checkShaderCompileErrors(unsigned int shader, const char *type) {
+static bool checkShaderCompileErrors(unsigned int shader, const char *type) {
   int success;
   char infoLog[1024];
 
   // maybe a little bit confusing here, anyway. that means:
   // throwing compiling error when the fragment or vertex shader fails,
   // otherwise it's a program failure :)
-  if (type != "PROGRAM") {
+  if (strcmp(type, "PROGRAM") != 0) {
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success) {
       glGetShaderInfoLog(shader, 1024, NULL, infoLog);
       printf("ERROR::SHADER::%s::COMPILATION_FAILED\n%s\n", type, infoLog);
-    } else {
-      glGetProgramiv(shader, GL_LINK_STATUS, &success);
-      if (!success) {
-        glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-        printf("ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
-      }
     }
+  } else {
+    glGetProgramiv(shader, GL_LINK_STATUS, &success);
+    if (!success) {
+      glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+      printf("ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
+    }
+  }
+  return success != 0;
+}
+
+// a binary only works with the driver that wrote it, so the driver strings
+// are part of the key next to the sources
+static uint64_t programKey(const char *vertexSource,
+                           const char *fragmentSource, const char *defines) {
+  const GLenum driverStrings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+  uint64_t hash = CACHE_HASH_INIT;
+  for (size_t i = 0; i < sizeof(driverStrings) / sizeof(GLenum); i++) {
+    const char *value = (const char *)glGetString(driverStrings[i]);
+    if (value) {
+      hash = cache_hash(hash, value, strlen(value) + 1);
+    }
+  }
+  // with the terminating zeros, "ab" + "c" and "a" + "bc" differ
+  hash = cache_hash(hash, vertexSource, strlen(vertexSource) + 1);
+  hash = cache_hash(hash, fragmentSource, strlen(fragmentSource) + 1);
+  return cache_hash(hash, defines, strlen(defines) + 1);
+}
+
+// $XDG_CACHE_HOME/LunaScape/shaders/<key>.bin
+static bool programCachePath(uint64_t key, char *path, size_t size) {
+  char dir[PATH_MAX];
+  if (!cache_directory("shaders", dir, sizeof(dir))) {
+    return false;
+  }
+  int written =
+      snprintf(path, size, "%s/%016llx.bin", dir, (unsigned long long)key);
+  return written > 0 && written < (int)size;
+}
+
+// links program from the cached binary. false on a miss, or when the driver
+// doesn't take the binary anymore (an update with the same version string).
+static bool loadCachedProgram(GLuint program, uint64_t key) {
+  char path[PATH_MAX];
+  if (!programCachePath(key, path, sizeof(path))) {
+    return false;
+  }
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return false;
   }
+
+  ProgramCacheHeader header;
+  void *binary = NULL;
+  bool read =
+      fread(&header, sizeof(header), 1, file) == 1 &&
+      memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+      header.key == key && header.length > 0 &&
+      (binary = malloc(header.length)) != NULL &&
+      fread(binary, 1, header.length, file) == header.length;
+  fclose(file);
+
+  GLint success = 0;
+  if (read) {
+    glProgramBinary(program, header.format, binary, (GLsizei)header.length);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+  }
+  free(binary);
+  return success != 0;
 }
 
-Shader createShader(const char *vertexPath, const char *fragmentPath) {
+// written to a temporary file and renamed, a second player starting at the
+// same time never reads half of it
+static void saveProgramBinary(GLuint program, uint64_t key) {
+  char path[PATH_MAX];
+  char temporary[PATH_MAX + 8];
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0 || !programCachePath(key, path, sizeof(path))) {
+    return;
+  }
+
+  void *binary = malloc((size_t)length);
+  if (!binary) {
+    return;
+  }
+  ProgramCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+  header.key = key;
+  GLsizei written = 0;
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &written, &format, binary);
+  header.format = format;
+  header.length = (uint32_t)written;
+
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE *file = fopen(temporary, "wb");
+  bool ok = file && written > 0 &&
+            fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(binary, 1, (size_t)written, file) == (size_t)written;
+  if (file) {
+    ok = fclose(file) == 0 && ok;
+  }
+  if (!ok || rename(temporary, path) != 0) {
+    remove(temporary);
+    printf("ERROR: Shader program could not be cached in %s\n", path);
+  }
+  free(binary);
+}
+
+// compiles one stage. The defines have to come after #version, so the
+// source is handed over in three pieces: the #version line, the defines and
+// the rest.
+static unsigned int compileStage(GLenum type, const char *source,
+                                 const char *defines, const char *name) {
+  const char *body = source;
+  if (strncmp(source, "#version", 8) == 0) {
+    const char *newline = strchr(source, '\n');
+    body = newline ? newline + 1 : source + strlen(source);
+  }
+  const char *pieces[3] = {source, defines, body};
+  GLint lengths[3] = {(GLint)(body - source), -1, -1};
+
+  unsigned int stage = glCreateShader(type);
+  glShaderSource(stage, 3, pieces, lengths);
+  glCompileShader(stage);
+  checkShaderCompileErrors(stage, name);
+  return stage;
+}
+
+Shader createShaderVariant(const char *vertexSource,
+                           const char *fragmentSource, const char *defines) {
   Shader shader;
   shader.ID = 0;
 
-  char *vertexData = readFile(vertexPath);
-  char *fragmentData = readFile(fragmentPath);
-
-  if (!vertexData || !fragmentData) {
-    printf("ERROR: Shader source code could not be read\n");
-    free(vertexData);
-    free(fragmentData);
+  if (!vertexSource || !fragmentSource) {
+    printf("ERROR: Shader source code is missing\n");
     return shader;
   }
+  if (!defines) {
+    defines = "";
+  }
 
-  // compile vertexShader
-  unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, (const char *const *)&vertexData, NULL);
-  glCompileShader(vertexShader);
-  checkShaderCompileErrors(vertexShader, "VERTEX");
+  Uint64 start = SDL_GetTicksNS();
+  shader.ID = glCreateProgram();
 
-  // compile fragment shader
-  unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, (const char *const *)&fragmentData, NULL);
-  glCompileShader(fragmentShader);
-  checkShaderCompileErrors(fragmentShader, "FRAGMENT");
+  // linked by this driver before, no compiling at all
+  uint64_t key = 0;
+  if (GLExt.programBinary) {
+    key = programKey(vertexSource, fragmentSource, defines);
+    if (loadCachedProgram(shader.ID, key)) {
+      SDL_Log("Shader program loaded from the cache in %.2f ms.",
+              (double)(SDL_GetTicksNS() - start) / 1e6);
+      return shader;
+    }
+    glProgramParameteri(shader.ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                        GL_TRUE);
+  }
+
+  unsigned int vertexShader =
+      compileStage(GL_VERTEX_SHADER, vertexSource, defines, "VERTEX");
+  unsigned int fragmentShader =
+      compileStage(GL_FRAGMENT_SHADER, fragmentSource, defines, "FRAGMENT");
 
   // links (compiles) shader together
-  shader.ID = glCreateProgram();
   glAttachShader(shader.ID, vertexShader);
   glAttachShader(shader.ID, fragmentShader);
   glLinkProgram(shader.ID);
-  checkShaderCompileErrors(shader.ID, "PROGRAM");
+  bool linked = checkShaderCompileErrors(shader.ID, "PROGRAM");
 
   // shaders are compiled and linked, if I'm right, I can delete the source..
   glDeleteShader(vertexShader);
   glDeleteShader(fragmentShader);
 
-  // I guess, I can free the data I've read from the files too.
-  free(vertexData);
-  free(fragmentData);
+  if (!linked) {
+    glDeleteProgram(shader.ID);
+    shader.ID = 0;
+    return shader;
+  }
+  SDL_Log("Shader program compiled in %.2f ms.",
+          (double)(SDL_GetTicksNS() - start) / 1e6);
+
+  // the next start loads it instead
+  if (GLExt.programBinary) {
+    saveProgramBinary(shader.ID, key);
+  }
 
   return shader;
 }
 
+Shader createShader(const char *vertexSource, const char *fragmentSource) {
+  return createShaderVariant(vertexSource, fragmentSource, NULL);
+}
+
+void initShaderVariants(ShaderVariants *variants, const char *vertexSource,
+                        const char *fragmentSource) {
+  memset(variants, 0, sizeof(ShaderVariants));
+  variants->vertexSource = vertexSource;
+  variants->fragmentSource = fragmentSource;
+}
+
+const Shader *getShaderVariant(ShaderVariants *variants,
+                               const char *defines) {
+  // a handful of variants at most, compared by content
+  for (int i = 0; i < variants->count; i++) {
+    if (strcmp(variants->defines[i], defines) == 0) {
+      return &variants->shaders[i];
+    }
+  }
+  if (variants->count == SHADER_VARIANT_MAX) {
+    printf("ERROR: Too many shader variants\n");
+    return NULL;
+  }
+
+  Shader shader = createShaderVariant(variants->vertexSource,
+                                      variants->fragmentSource, defines);
+  if (!shader.ID) {
+    return NULL;
+  }
+  variants->defines[variants->count] = defines;
+  variants->shaders[variants->count] = shader;
+  return &variants->shaders[variants->count++];
+}
+
+void deleteShaderVariants(ShaderVariants *variants) {
+  for (int i = 0; i < variants->count; i++) {
+    deleteShader(&variants->shaders[i]);
+  }
+  variants->count = 0;
+}
+
 void useShader(const Shader *shader) { glUseProgram(shader->ID); }
 
 void deleteShader(Shader *shader) {
   glDeleteProgram(shader->ID);
   shader->ID = 0;
-}
\ No newline at end of file
+}
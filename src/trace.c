@@ -0,0 +1,164 @@
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static struct {
+  bool enabled;
+  Uint64 startTicks; // timestamps in the dump are relative to this
+  SDL_SpinLock lock; // only for registering, never while recording
+  TraceRing rings[TRACE_MAX_THREADS];
+  int ringCount;
+} tracer;
+
+// ring of the calling thread, NULL if it doesn't record
+static _Thread_local TraceRing *threadRing = NULL;
+
+void trace_init(void) {
+  tracer.startTicks = SDL_GetTicksNS();
+  tracer.enabled = true;
+}
+
+void trace_register_thread(const char *name) {
+  if (!tracer.enabled || threadRing) {
+    return;
+  }
+
+  SDL_LockSpinlock(&tracer.lock);
+
+  // a restarted thread (new video after a reload) continues where the old one
+  // stopped, so the dump shows one track per role
+  TraceRing *ring = NULL;
+  for (int i = 0; i < tracer.ringCount; i++) {
+    if (!tracer.rings[i].active &&
+        strcmp(tracer.rings[i].threadName, name) == 0) {
+      ring = &tracer.rings[i];
+      break;
+    }
+  }
+
+  if (!ring && tracer.ringCount < TRACE_MAX_THREADS) {
+    TraceEvent *events =
+        (TraceEvent *)calloc(TRACE_RING_EVENTS, sizeof(TraceEvent));
+    if (events) {
+      ring = &tracer.rings[tracer.ringCount++];
+      ring->threadName = name;
+      ring->events = events;
+      SDL_SetAtomicU32(&ring->written, 0);
+    }
+  }
+
+  if (ring) {
+    ring->active = true;
+  }
+  SDL_UnlockSpinlock(&tracer.lock);
+
+  if (!ring) {
+    SDL_Log("Trace: no ring left for thread %s, it is not recorded", name);
+    return;
+  }
+  threadRing = ring;
+}
+
+void trace_unregister_thread(void) {
+  if (!threadRing) {
+    return;
+  }
+  SDL_LockSpinlock(&tracer.lock);
+  threadRing->active = false;
+  SDL_UnlockSpinlock(&tracer.lock);
+  threadRing = NULL;
+}
+
+Uint64 trace_now(void) { return threadRing ? SDL_GetTicksNS() : 0; }
+
+void trace_event(const char *name, Uint64 start) {
+  TraceRing *ring = threadRing;
+  if (!ring) {
+    return;
+  }
+
+  // only this thread writes, the atomic publishes the event for the dump
+  Uint32 written = SDL_GetAtomicU32(&ring->written);
+  TraceEvent *event = &ring->events[written & (TRACE_RING_EVENTS - 1)];
+  event->name = name;
+  event->start = start;
+  event->end = SDL_GetTicksNS();
+  SDL_SetAtomicU32(&ring->written, written + 1);
+}
+
+// microseconds since trace_init, what trace_event JSON expects
+static double trace_us(Uint64 ticks) {
+  return ticks > tracer.startTicks ? (ticks - tracer.startTicks) / 1e3 : 0.0;
+}
+
+bool trace_dump(const char *path) {
+  if (!tracer.enabled) {
+    return false;
+  }
+
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    SDL_Log("Trace: can't write %s", path);
+    return false;
+  }
+
+  // rings are only added while holding the lock, the events themselves are
+  // read without it
+  SDL_LockSpinlock(&tracer.lock);
+  int ringCount = tracer.ringCount;
+  SDL_UnlockSpinlock(&tracer.lock);
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"args\":{\"name\":\"LunaScape\"}}");
+
+  int eventCount = 0;
+  for (int i = 0; i < ringCount; i++) {
+    TraceRing *ring = &tracer.rings[i];
+    int tid = i + 1;
+
+    fprintf(file,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}",
+            tid, ring->threadName);
+
+    Uint32 written = SDL_GetAtomicU32(&ring->written);
+    Uint32 first =
+        written > TRACE_RING_EVENTS ? written - TRACE_RING_EVENTS : 0;
+    for (Uint32 e = first; e != written; e++) {
+      TraceEvent event = ring->events[e & (TRACE_RING_EVENTS - 1)];
+      if (!event.name || event.end < event.start) {
+        continue;
+      }
+      // complete events, a begin and its end can't be split by the ring
+      fprintf(file,
+              ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+              "\"ts\":%.3f,\"dur\":%.3f}",
+              event.name, tid, trace_us(event.start),
+              (event.end - event.start) / 1e3);
+      eventCount++;
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+  bool ok = fclose(file) == 0;
+
+  if (ok) {
+    printf("Trace: wrote %d events of %d threads to %s\n", eventCount,
+           ringCount, path);
+  }
+  return ok;
+}
+
+void trace_shutdown(void) {
+  SDL_LockSpinlock(&tracer.lock);
+  for (int i = 0; i < tracer.ringCount; i++) {
+    free(tracer.rings[i].events);
+    tracer.rings[i].events = NULL;
+  }
+  tracer.ringCount = 0;
+  tracer.enabled = false;
+  SDL_UnlockSpinlock(&tracer.lock);
+  threadRing = NULL;
+}
@@ -0,0 +1,230 @@
+#include "videoDecoder.h"
+
+static const enum AVDiscard skip_levels[] = {AVDISCARD_DEFAULT,
+                                             AVDISCARD_NONREF,
+                                             AVDISCARD_NONKEY};
+
+static void set_skip_level(VideoDecoder *decoder, int level) {
+  decoder->video->pCodecCtx->skip_frame = skip_levels[level];
+  SDL_SetAtomicInt(&decoder->skipLevel, level);
+}
+
+// the hw transfer pool belongs to the decode thread and is replaced when the
+// decoder recreates its surfaces, so its counters are copied out here
+static void update_pool_stats(VideoDecoder *decoder) {
+  if (!decoder->video->hw_frame_pool) {
+    return;
+  }
+  FramePoolStats stats;
+  frame_pool_get_stats(decoder->video->hw_frame_pool, &stats);
+  SDL_SetAtomicInt(&decoder->poolFrames, stats.requests);
+  SDL_SetAtomicInt(&decoder->poolAllocations, stats.misses);
+}
+
+/**
+ * Returns true when the decoded frame is late already, it would never be
+ * shown in time. Late frames in a row make the decoder skip more frames,
+ * frames that are ahead of the clock make it skip less again.
+ */
+static bool drop_late_frame(VideoDecoder *decoder, vFrame *slot) {
+
+  // a seek or a restart, the old lateness doesn't matter anymore
+  if (slot->serial != decoder->policySerial) {
+    decoder->policySerial = slot->serial;
+    decoder->lateStreak = 0;
+    decoder->aheadStreak = 0;
+    set_skip_level(decoder, 0);
+  }
+
+  double clockTime;
+  if (!decoder->clock ||
+      !playback_clock_peek(decoder->clock, slot->serial, &clockTime)) {
+    return false;
+  }
+
+  double lateness = clockTime - slot->pts;
+  int level = SDL_GetAtomicInt(&decoder->skipLevel);
+
+  if (lateness > decoder->frameDuration) {
+    decoder->aheadStreak = 0;
+    if (++decoder->lateStreak >= VIDEO_SKIP_ESCALATE && level < 2) {
+      set_skip_level(decoder, level + 1);
+      decoder->lateStreak = 0;
+      SDL_Log("Video decoding is behind by %.0f ms, skip level %d.",
+              lateness * 1000, level + 1);
+    }
+    SDL_AddAtomicInt(&decoder->droppedLate, 1);
+    return true;
+  }
+
+  decoder->lateStreak = 0;
+  if (level > 0 && lateness < -decoder->frameDuration &&
+      ++decoder->aheadStreak >= VIDEO_SKIP_DEESCALATE) {
+    set_skip_level(decoder, level - 1);
+    decoder->aheadStreak = 0;
+    SDL_Log("Video decoding caught up, skip level %d.", level - 1);
+  }
+  return false;
+}
+
+static int video_decode_thread_func(void *data) {
+  VideoDecoder *decoder = (VideoDecoder *)data;
+  VideoContainer *video = decoder->video;
+  PacketQueue *queue = &video->demuxer->videoQueue;
+  AVRational time_base =
+      video->pFormatCtx->streams[video->videoStreamIndex]->time_base;
+  trace_register_thread("VideoDecodeThread");
+
+  while (decoder->running) {
+
+    // ring is full or the video is paused, the render loop has to catch up
+    // first. Popped frames, unpausing, seeking and stopping wake the thread,
+    // the timeout is only a safety net.
+    vFrame *slot = frame_ring_peek_writable(decoder->ring);
+    if (!slot || video->paused) {
+      frame_ring_wait(decoder->ring, VIDEO_DECODER_WAIT_MS);
+      continue;
+    }
+
+    int ret = decoder->primed ? 1 : video_container_decode_frame(video, slot);
+    decoder->primed = false;
+    SDL_SetAtomicInt(&decoder->finished, ret == 0);
+    if (ret > 0) {
+      int64_t pts = slot->frame->best_effort_timestamp;
+      slot->pts = pts == AV_NOPTS_VALUE ? 0.0 : pts * av_q2d(time_base);
+      slot->serial = video->serial;
+
+      // first frame after a seek: everything before the seek target was only
+      // decoded as a reference
+      if (slot->serial != decoder->trimSerial) {
+        decoder->trimSerial = slot->serial;
+        decoder->trimming = demuxer_get_seek_target(
+            video->demuxer, queue, slot->serial, &decoder->trimPts);
+      }
+      if (decoder->trimming) {
+        if (slot->pts + decoder->frameDuration <= decoder->trimPts) {
+          continue;
+        }
+        decoder->trimming = false;
+      }
+
+      // frames of the old position that were still inside the decoder, or
+      // frames that are late already. Both are never converted.
+      if (slot->serial != packet_queue_serial(queue) ||
+          drop_late_frame(decoder, slot)) {
+        continue;
+      }
+
+      if (!video_container_convert_frame(video, slot)) {
+        continue;
+      }
+      frame_ring_push(decoder->ring);
+      SDL_AddAtomicInt(&decoder->decoded, 1);
+      update_pool_stats(decoder);
+    } else if (ret == 0) {
+      // end of the file without looping (the restart failed), wait for a
+      // seek
+      frame_ring_wait(decoder->ring, VIDEO_DECODER_WAIT_MS);
+    } else {
+      // demuxer was aborted, the thread gets stopped soon
+      frame_ring_wait(decoder->ring, VIDEO_DECODER_WAIT_MS);
+    }
+  }
+
+  trace_unregister_thread();
+  return 0;
+}
+
+VideoDecoder *video_decoder_create(VideoContainer *video,
+                                   PlaybackClock *clock) {
+  VideoDecoder *decoder = (VideoDecoder *)calloc(1, sizeof(VideoDecoder));
+  if (!decoder) {
+    SDL_Log("VideoDecoder - Memory allocation error.");
+    return NULL;
+  }
+
+  decoder->video = video;
+  decoder->clock = clock;
+  decoder->policySerial = -1;
+  decoder->trimSerial = -1;
+
+  // a frame is late when the next one should be shown already
+  AVStream *stream = video->pFormatCtx->streams[video->videoStreamIndex];
+  AVRational frame_rate = av_guess_frame_rate(video->pFormatCtx, stream, NULL);
+  decoder->frameDuration = frame_rate.num > 0 && frame_rate.den > 0
+                               ? (double)frame_rate.den / frame_rate.num
+                               : 1.0 / 30.0;
+  decoder->ring = frame_ring_create(video);
+  if (!decoder->ring) {
+    SDL_Log("Failed to initialize the frame ring.");
+    free(decoder);
+    return NULL;
+  }
+
+  return decoder;
+}
+
+bool video_decoder_prime(VideoDecoder *decoder) {
+  vFrame *slot = frame_ring_peek_writable(decoder->ring);
+  if (!slot || decoder->thread) {
+    return false;
+  }
+
+  // only decoded, it is converted by the thread once the renderer attached
+  // its PBO slots to the ring
+  decoder->primed = video_container_decode_frame(decoder->video, slot) > 0;
+  return decoder->primed;
+}
+
+bool video_decoder_start(VideoDecoder *decoder) {
+  decoder->running = true;
+  decoder->thread =
+      SDL_CreateThread(video_decode_thread_func, "VideoDecodeThread", decoder);
+  if (!decoder->thread) {
+    SDL_Log("Failed to create video decode thread: %s", SDL_GetError());
+    decoder->running = false;
+    return false;
+  }
+
+  return true;
+}
+
+void video_decoder_wake(VideoDecoder *decoder) {
+  frame_ring_wake(decoder->ring);
+}
+
+void video_decoder_stop(VideoDecoder *decoder) {
+  decoder->running = false;
+  if (decoder->thread) {
+    video_decoder_wake(decoder);
+    SDL_WaitThread(decoder->thread, NULL);
+    decoder->thread = NULL;
+  }
+}
+
+void video_decoder_destroy(VideoDecoder *decoder) {
+  if (!decoder) {
+    return;
+  }
+
+  video_decoder_stop(decoder);
+  frame_ring_destroy(decoder->ring);
+  free(decoder);
+}
+
+bool video_decoder_is_finished(VideoDecoder *decoder) {
+  return SDL_GetAtomicInt(&decoder->finished) != 0;
+}
+
+void video_decoder_count_render_drop(VideoDecoder *decoder) {
+  SDL_AddAtomicInt(&decoder->droppedRender, 1);
+}
+
+void video_decoder_get_stats(VideoDecoder *decoder, VideoDecoderStats *stats) {
+  stats->decoded = SDL_GetAtomicInt(&decoder->decoded);
+  stats->droppedLate = SDL_GetAtomicInt(&decoder->droppedLate);
+  stats->droppedRender = SDL_GetAtomicInt(&decoder->droppedRender);
+  stats->skipLevel = SDL_GetAtomicInt(&decoder->skipLevel);
+  stats->poolFrames = SDL_GetAtomicInt(&decoder->poolFrames);
+  stats->poolAllocations = SDL_GetAtomicInt(&decoder->poolAllocations);
+}
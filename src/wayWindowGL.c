@@ -59,6 +59,16 @@ SDL_GLContext initOpenGLContext_and_glad(SDL_Window *window)
 
   SDL_GLContext glContext = SDL_GL_CreateContext(window);
 
+  // drivers like Mesa llvmpipe don't offer 4.6 yet. The shaders only need
+  // 4.1, newer features are checked in loadGLExtensions.
+  if (!glContext)
+  {
+    SDL_Log("No OpenGL 4.6 context (%s), trying 4.1", SDL_GetError());
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+    glContext = SDL_GL_CreateContext(window);
+  }
+
   if (!glContext)
   {
     SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
@@ -77,6 +87,8 @@ SDL_GLContext initOpenGLContext_and_glad(SDL_Window *window)
     return false;
   }
 
+  loadGLExtensions();
+
   return glContext;
 }
 